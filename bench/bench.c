@@ -0,0 +1,129 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Zeroed bytes after the fixture, so that the old code that compares
+ * whole keywords at the end of a line never reads past the buffer */
+#define BENCH_PAD 64
+
+double benchNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static char *readFile(const char *path, size_t *len)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+
+    char *data = NULL;
+    if (fseek(fp, 0, SEEK_END) == 0)
+    {
+        long size = ftell(fp);
+        rewind(fp);
+
+        if (size >= 0 && (data = malloc(size)) != NULL)
+        {
+            *len = fread(data, 1, size, fp);
+        }
+    }
+
+    fclose(fp);
+    return data;
+}
+
+/* Concatenate the files in argv[1..argc-1] and repeat them until there
+ * are at least min_size bytes. Exit if there is nothing to read. */
+char *benchFixture(int argc, char **argv, size_t min_size, size_t *len)
+{
+    size_t size = 0, cap = min_size + BENCH_PAD;
+    char *text = malloc(cap);
+    if (text == NULL)
+    {
+        fprintf(stderr, "Not enough memory for the fixture\n");
+        exit(EXIT_FAILURE);
+    }
+
+    while (size < min_size)
+    {
+        size_t start = size;
+        for (int i = 1; i < argc; i++)
+        {
+            size_t n = 0;
+            char *data = readFile(argv[i], &n);
+            if (data == NULL)
+                continue;
+
+            if (size + n + BENCH_PAD > cap)
+            {
+                cap = (size + n) * 2 + BENCH_PAD;
+                char *grown = realloc(text, cap);
+                if (grown == NULL)
+                {
+                    fprintf(stderr, "Not enough memory for the fixture\n");
+                    exit(EXIT_FAILURE);
+                }
+                text = grown;
+            }
+
+            memcpy(text + size, data, n);
+            size += n;
+            free(data);
+        }
+
+        if (size == start)
+        {
+            fprintf(stderr, "Usage: %s <fixture files...>\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memset(text + size, 0, BENCH_PAD);
+    *len = size;
+    return text;
+}
+
+/* Replace the newlines of text with '\0' and return where each line
+ * starts, the way the rows of a buffer are laid out */
+char **benchSplitLines(char *text, size_t len, size_t *count)
+{
+    size_t n = 1;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (text[i] == '\n')
+            n++;
+    }
+
+    char **lines = malloc(n * sizeof(char *));
+    if (lines == NULL)
+    {
+        fprintf(stderr, "Not enough memory for the fixture\n");
+        exit(EXIT_FAILURE);
+    }
+
+    n = 0;
+    lines[n++] = text;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (text[i] == '\n')
+        {
+            text[i] = '\0';
+            lines[n++] = text + i + 1;
+        }
+    }
+
+    *count = n;
+    return lines;
+}
+
+void benchReport(const char *what, size_t bytes, double secs)
+{
+    printf("  %-32s %9.3f ms %10.1f MB/s\n", what, secs * 1e3, bytes / secs / 1e6);
+}
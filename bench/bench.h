@@ -0,0 +1,18 @@
+#ifndef __EDITOR_BENCH_H
+#define __EDITOR_BENCH_H
+
+#include <stddef.h>
+
+/* Microbenchmarks of the hot paths of the editor against the code they
+ * replaced. They are built against the release objects with `make bench`
+ * and run on a fixture made of the files given on the command line,
+ * repeated until it is large enough to time. */
+
+#define BENCH_RUNS 5
+
+double benchNow(void);
+char *benchFixture(int argc, char **argv, size_t min_size, size_t *len);
+char **benchSplitLines(char *text, size_t len, size_t *count);
+void benchReport(const char *what, size_t bytes, double secs);
+
+#endif /* __EDITOR_BENCH_H */
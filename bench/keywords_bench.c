@@ -0,0 +1,137 @@
+#include "bench.h"
+
+#include "syntax.h"
+#include "keywords.h"
+#include "textbuffer.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Classify the keyword at s the way Highlight_Keywords did before the
+ * trie: memcmp() against every keyword of every group, in order. */
+static int linearMatch(const Syntax *syntax, const char *s, unsigned char *color)
+{
+    SyntaxGroup *groups = syntax->groups;
+    for (size_t i = 0; i < syntax->group_num; i++)
+    {
+        char **keywords = groups[i].keywords;
+        for (int j = 0; keywords[j]; j++)
+        {
+            int klen = strlen(keywords[j]);
+
+            if (!memcmp(s, keywords[j], klen) && is_separator(*(s + klen)))
+            {
+                switch (groups[i].type)
+                {
+                case GROUP_TYPE_NORMAL:
+                    if (!is_separator(*(s + klen))) continue;
+                    break;
+                case GROUP_TYPE_FUNCTION:
+                    if (*(s + klen) != '(') continue;
+                    break;
+                case GROUP_TYPE_FORCE:
+                    break;
+                default:
+                    continue;
+                }
+
+                *color = groups[i].color;
+                return klen;
+            }
+        }
+    }
+    return 0;
+}
+
+static int trieMatch(const Syntax *syntax, const char *s, unsigned char *color)
+{
+    return keywordTrieMatch(syntax->keywords, s, color);
+}
+
+typedef int (*MatchFn)(const Syntax *syntax, const char *s, unsigned char *color);
+
+/* Try every token start of every line like the highlighter does, and
+ * return a checksum of what was matched */
+static unsigned long scanKeywords(const Syntax *syntax, char **lines, size_t count, MatchFn match)
+{
+    unsigned long sum = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const char *p = lines[i];
+        bool prev_sep = true;
+
+        while (*p)
+        {
+            unsigned char color;
+            int klen = prev_sep ? match(syntax, p, &color) : 0;
+
+            if (klen > 0)
+            {
+                sum = sum * 31 + (unsigned long)(p - lines[i]) * 7 + klen * 3 + color;
+                p += klen;
+                prev_sep = false;
+                continue;
+            }
+
+            prev_sep = is_separator(*p);
+            p++;
+        }
+    }
+
+    return sum;
+}
+
+static double timeScan(const Syntax *syntax, char **lines, size_t count, MatchFn match, unsigned long *sum)
+{
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++)
+    {
+        double start = benchNow();
+        *sum = scanKeywords(syntax, lines, count, match);
+        double secs = benchNow() - start;
+
+        if (run == 0 || secs < best)
+            best = secs;
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    size_t len;
+    char *text = benchFixture(argc, argv, 512 << 10, &len);
+
+    size_t count;
+    char **lines = benchSplitLines(text, len, &count);
+
+    TextBuffer buf = {0};
+    editorSelectSyntaxHighlight(&buf, "bench.c");
+    if (buf.syntax == NULL || buf.syntax->keywords == NULL)
+    {
+        fprintf(stderr, "No keywords for C sources\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Keywords: %zu lines, %.1f MB of C\n", count, len / 1e6);
+
+    unsigned long linear_sum, trie_sum;
+    double linear = timeScan(buf.syntax, lines, count, linearMatch, &linear_sum);
+    double trie = timeScan(buf.syntax, lines, count, trieMatch, &trie_sum);
+
+    benchReport("linear scan", len, linear);
+    benchReport("trie", len, trie);
+    printf("  speedup %.1fx\n", linear / trie);
+
+    if (linear_sum != trie_sum)
+    {
+        fprintf(stderr, "  the trie doesn't match the same keywords!\n");
+        return EXIT_FAILURE;
+    }
+
+    free(lines);
+    free(text);
+    return EXIT_SUCCESS;
+}
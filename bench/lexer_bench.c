@@ -0,0 +1,304 @@
+#include "bench.h"
+
+#include "syntax.h"
+#include "keywords.h"
+#include "lexer.h"
+#include "render.h"
+#include "textbuffer.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* The highlighter before the DFA lexer: at every byte, a chain of
+ * predicates is tried in order until one of them consumes it. */
+
+typedef struct HighlightState
+{
+    RenderRow *render;
+    const Syntax *syntax;
+    const char *r_current;
+    unsigned char *hl_current;
+    int in_string;
+    bool in_comment;
+    bool prev_sep;
+} HighlightState;
+
+static bool Highlight_Skip(HighlightState *s)
+{
+    if (*(s->hl_current) != HL_NORMAL)
+    {
+        s->r_current++;
+        s->hl_current++;
+        s->prev_sep = 1;
+        return true;
+    }
+    return false;
+}
+
+static bool Highlight_SingleLineComment(HighlightState *s)
+{
+    const char *start = s->syntax->singleline_comment_start;
+
+    if (s->prev_sep && *s->r_current == start[0] && *(s->r_current + 1) == start[1])
+    {
+        memset(s->hl_current, HL_COMMENT, s->render->size - (s->hl_current-s->render->hl));
+        return true;
+    }
+    return false;
+}
+
+static bool Highlight_MultiLineComment(HighlightState *s)
+{
+    const char *start = s->syntax->multiline_comment_start;
+    const char *end = s->syntax->multiline_comment_end;
+
+    if (s->in_comment)
+    {
+        *s->hl_current = HL_MLCOMMENT;
+        if (*s->r_current == end[0] && *(s->r_current + 1) == end[1])
+        {
+            *(s->hl_current + 1) = HL_MLCOMMENT;
+            s->r_current += 2;
+            s->hl_current += 2;
+            s->in_comment = 0;
+            s->prev_sep = 1;
+        }
+        else
+        {
+            s->r_current++;
+            s->hl_current++;
+            s->prev_sep = 0;
+        }
+        return true;
+    }
+    else if (*s->r_current == start[0] && *(s->r_current + 1) == start[1])
+    {
+        *(s->hl_current) = HL_MLCOMMENT;
+        *(s->hl_current + 1) = HL_MLCOMMENT;
+        s->r_current += 2;
+        s->hl_current += 2;
+        s->in_comment = 1;
+        s->prev_sep = 0;
+        return true;
+    }
+    return false;
+}
+
+static bool Highlight_String(HighlightState *s)
+{
+    if (s->in_string)
+    {
+        *(s->hl_current) = HL_STRING;
+        if (*s->r_current == '\\' && *(s->r_current + 1))
+        {
+            *(s->hl_current + 1) = HL_STRING;
+            s->r_current += 2;
+            s->hl_current += 2;
+        }
+        else
+        {
+            if (*s->r_current == s->in_string)
+                s->in_string = 0;
+            s->r_current++;
+            s->hl_current++;
+        }
+        s->prev_sep = 0;
+        return true;
+    }
+    else if (*s->r_current == '"' || *s->r_current == '\'')
+    {
+        s->in_string = *s->r_current;
+        *(s->hl_current) = HL_STRING;
+        s->r_current++;
+        s->hl_current++;
+        s->prev_sep = 0;
+        return true;
+    }
+    return false;
+}
+
+static bool Highlight_Number(HighlightState *s)
+{
+    bool is_number = (isdigit(*s->r_current) && (s->prev_sep || *(s->hl_current - 1) == HL_NUMBER));
+    bool is_float = (*s->r_current == '.' && s->hl_current > s->render->hl && *(s->hl_current - 1) == HL_NUMBER);
+
+    if (is_number || is_float)
+    {
+        *(s->hl_current) = HL_NUMBER;
+        s->r_current++;
+        s->hl_current++;
+        s->prev_sep = 0;
+        return true;
+    }
+    return false;
+}
+
+static bool Highlight_Keywords(HighlightState *s)
+{
+    if (!s->prev_sep || s->syntax->keywords == NULL)
+        return false;
+
+    unsigned char color;
+    int klen = keywordTrieMatch(s->syntax->keywords, s->r_current, &color);
+    if (klen == 0)
+        return false;
+
+    memset(s->hl_current, color, klen);
+    s->r_current += klen;
+    s->hl_current += klen;
+    s->prev_sep = 0;
+    return true;
+}
+
+static unsigned char chainRun(const Syntax *syntax, RenderRow *render, unsigned char state)
+{
+    /* Drop the old highlight, keeping what the render has set */
+    for (size_t i = 0; i < render->size; i++)
+    {
+        if (render->hl[i] != HL_TAB && render->hl[i] != HL_NONPRINT)
+            render->hl[i] = HL_NORMAL;
+    }
+
+    HighlightState s;
+    s.render = render;
+    s.syntax = syntax;
+    s.r_current = render->c;
+    s.hl_current = render->hl;
+    s.in_string = 0;
+    s.in_comment = (state == HL_STATE_COMMENT);
+    s.prev_sep = 1;
+
+    while (*s.r_current && isspace(*s.r_current))
+    {
+        s.r_current++;
+        s.hl_current++;
+    }
+
+    while (*s.r_current)
+    {
+        if (Highlight_Skip(&s))               continue;
+        if (Highlight_MultiLineComment(&s))   continue;
+        if (Highlight_SingleLineComment(&s))  break;
+        if (Highlight_String(&s))             continue;
+        if (Highlight_Number(&s))             continue;
+        if (Highlight_Keywords(&s))           continue;
+
+        s.prev_sep = is_separator(*s.r_current);
+        s.r_current++;
+        s.hl_current++;
+    }
+
+    return s.in_comment ? HL_STATE_COMMENT : HL_STATE_NORMAL;
+}
+
+static unsigned char dfaRun(const Syntax *syntax, RenderRow *render, unsigned char state)
+{
+    bool lossy;
+    return lexerRun(syntax->lexer, syntax, render, state, &lossy);
+}
+
+typedef unsigned char (*LexFn)(const Syntax *syntax, RenderRow *render, unsigned char state);
+
+/* Highlight every row from the top, carrying the state across them like
+ * a full highlight of the buffer */
+static double timeLex(const Syntax *syntax, RenderRow *rows, size_t count, LexFn lex)
+{
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++)
+    {
+        double start = benchNow();
+
+        unsigned char state = HL_STATE_NORMAL;
+        for (size_t i = 0; i < count; i++)
+            state = lex(syntax, &rows[i], state);
+
+        double secs = benchNow() - start;
+        if (run == 0 || secs < best)
+            best = secs;
+    }
+    return best;
+}
+
+/* Give every line a render with no marks. Tabs become spaces, so that
+ * both highlighters see the same bytes without the render in between. */
+static RenderRow *makeRenders(char **lines, size_t count)
+{
+    RenderRow *rows = malloc(count * sizeof(RenderRow));
+    if (rows == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t size = strlen(lines[i]);
+        for (size_t j = 0; j < size; j++)
+        {
+            if (lines[i][j] == '\t')
+                lines[i][j] = ' ';
+        }
+
+        rows[i] = (RenderRow){lines[i], calloc(size + 1, 1), size};
+        if (rows[i].hl == NULL)
+            return NULL;
+    }
+
+    return rows;
+}
+
+int main(int argc, char **argv)
+{
+    size_t len;
+    char *text = benchFixture(argc, argv, 8 << 20, &len);
+
+    size_t count;
+    char **lines = benchSplitLines(text, len, &count);
+
+    TextBuffer buf = {0};
+    editorSelectSyntaxHighlight(&buf, "bench.c");
+    if (buf.syntax == NULL || buf.syntax->lexer == NULL)
+    {
+        fprintf(stderr, "No lexer for C sources\n");
+        return EXIT_FAILURE;
+    }
+
+    RenderRow *chain_rows = makeRenders(lines, count);
+    RenderRow *dfa_rows = makeRenders(lines, count);
+    if (chain_rows == NULL || dfa_rows == NULL)
+    {
+        fprintf(stderr, "Not enough memory for the renders\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Lexer: %zu lines, %.1f MB of C\n", count, len / 1e6);
+
+    double chain = timeLex(buf.syntax, chain_rows, count, chainRun);
+    double dfa = timeLex(buf.syntax, dfa_rows, count, dfaRun);
+
+    benchReport("predicate chain", len, chain);
+    benchReport("DFA", len, dfa);
+    printf("  speedup %.1fx\n", chain / dfa);
+
+    size_t differ = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (memcmp(chain_rows[i].hl, dfa_rows[i].hl, chain_rows[i].size) != 0)
+            differ++;
+    }
+
+    /* Expected where a block comment opener is inside a string: it no
+     * longer opens a comment, which changes the lines below it as well */
+    printf("  %zu lines highlighted differently\n", differ);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        free(chain_rows[i].hl);
+        free(dfa_rows[i].hl);
+    }
+    free(chain_rows);
+    free(dfa_rows);
+    free(lines);
+    free(text);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,157 @@
+#define _GNU_SOURCE
+
+#include "bench.h"
+
+#include "memsearch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+/* Every search counts all the occurrences of the needle in the fixture,
+ * so a needle that isn't there measures a full scan */
+static const char *needles[] = {
+    "zq",
+    "editorGetRow",
+    "no_such_identifier",
+    "a needle that is much longer than any token of the sources",
+    NULL
+};
+
+static size_t countMemFind(const char *text, size_t len, const char *needle, size_t m)
+{
+    size_t count = 0;
+    const char *p = text, *end = text + len;
+
+    while ((p = mem_find(p, end - p, needle, m)) != NULL)
+    {
+        count++;
+        p++;
+    }
+    return count;
+}
+
+static size_t countMemmem(const char *text, size_t len, const char *needle, size_t m)
+{
+    size_t count = 0;
+    const char *p = text, *end = text + len;
+
+    while ((p = memmem(p, end - p, needle, m)) != NULL)
+    {
+        count++;
+        p++;
+    }
+    return count;
+}
+
+static size_t countMemRFind(const char *text, size_t len, const char *needle, size_t m)
+{
+    size_t count = 0;
+    size_t n = len;
+    const char *p;
+
+    /* The next match may overlap this one, so only its last byte goes */
+    while (n >= m && (p = mem_rfind(text, n, needle, m)) != NULL)
+    {
+        count++;
+        n = p - text + m - 1;
+    }
+    return count;
+}
+
+/* The row by row searches of the find command before mem_find */
+static size_t countStrstr(char **lines, size_t count, const char *needle)
+{
+    size_t total = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const char *p = lines[i];
+        while ((p = strstr(p, needle)) != NULL)
+        {
+            total++;
+            p++;
+        }
+    }
+    return total;
+}
+
+/* The last match of a row was found by calling strstr() from the start
+ * until there were no more, for every row on the way back */
+static size_t countStrstrBackward(char **lines, size_t count, const char *needle)
+{
+    size_t total = 0;
+
+    for (size_t i = count; i-- > 0;)
+    {
+        const char *found, *current = lines[i];
+        while ((found = strstr(current, needle)) != NULL)
+        {
+            total++;
+            current = found + 1;
+        }
+    }
+    return total;
+}
+
+#define TIME_SEARCH(what, bytes, expr, result)          \
+    do                                                  \
+    {                                                   \
+        double best = 0;                                \
+        for (int run = 0; run < BENCH_RUNS; run++)      \
+        {                                               \
+            double start = benchNow();                  \
+            result = (expr);                            \
+            double secs = benchNow() - start;           \
+            if (run == 0 || secs < best)                \
+                best = secs;                            \
+        }                                               \
+        benchReport(what, bytes, best);                 \
+    } while (0)
+
+int main(int argc, char **argv)
+{
+    size_t len;
+    char *text = benchFixture(argc, argv, 32 << 20, &len);
+
+    char *split = malloc(len + 1);
+    if (split == NULL)
+    {
+        fprintf(stderr, "Not enough memory for the fixture\n");
+        return EXIT_FAILURE;
+    }
+    memcpy(split, text, len + 1);
+
+    size_t count;
+    char **lines = benchSplitLines(split, len, &count);
+
+    printf("Substring search: %zu lines, %.1f MB\n", count, len / 1e6);
+
+    bool differ = false;
+    for (int i = 0; needles[i]; i++)
+    {
+        const char *needle = needles[i];
+        size_t m = strlen(needle);
+        size_t find, rfind, mm, ss, ssb;
+
+        printf(" \"%s\"\n", needle);
+        TIME_SEARCH("mem_find", len, countMemFind(text, len, needle, m), find);
+        TIME_SEARCH("memmem", len, countMemmem(text, len, needle, m), mm);
+        TIME_SEARCH("strstr by row", len, countStrstr(lines, count, needle), ss);
+        TIME_SEARCH("mem_rfind", len, countMemRFind(text, len, needle, m), rfind);
+        TIME_SEARCH("strstr by row, backward", len, countStrstrBackward(lines, count, needle), ssb);
+        printf("  %zu matches\n", find);
+
+        if (find != mm || find != ss || find != rfind || find != ssb)
+        {
+            fprintf(stderr, "  the searches don't agree: %zu %zu %zu %zu %zu\n", find, mm, ss, rfind, ssb);
+            differ = true;
+        }
+    }
+
+    free(lines);
+    free(split);
+    free(text);
+    return differ ? EXIT_FAILURE : EXIT_SUCCESS;
+}
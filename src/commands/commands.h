@@ -7,6 +7,9 @@ typedef struct Window Window;
 void editorShell(int fd);
 
 int editorOpen(Window *W, const char *file_path);
+void editorLoadAll(TextBuffer *buf);
+int editorLoadProgress(TextBuffer *buf);
+void editorStopLoading(TextBuffer *buf);
 void editorOpenFromWin(Window *W, int fd);
 int editorSave(TextBuffer *buf);
 int editorSaveAs(TextBuffer *buf, int fd);
@@ -10,6 +10,10 @@
 #include "syntax.h"
 #include "cursor.h"
 #include "textbuffer.h"
+#include "linescan.h"
+#include "spsc.h"
+#include "utf8.h"
+#include "loop.h"
 
 #include <stdio.h>
 #include <errno.h>
@@ -18,7 +22,306 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LOAD_FIRST_CHUNK (1 << 16) /* More than enough for the first screen */
+#define LOAD_CHUNK (1 << 22)
+#define LOAD_QUEUE_SIZE 16
+
+/* A mapped file is split in rows a block at a time: editorOpen() loads
+ * just the first screen and a worker thread indexes the rest. The blocks
+ * are handed to the main loop through a queue and a byte is written on
+ * the wake pipe for each of them, the rows are created by the main
+ * thread only. The rows point straight into the mapping and get copied
+ * only when they are modified. */
+typedef struct LoadBlock
+{
+    size_t from, to;   /* Range of the store, cut after a line feed */
+    size_t *newlines;  /* Offsets of the line feeds, relative to from */
+    size_t count;      /* (size_t)-1 if the worker ran out of memory */
+} LoadBlock;
+
+struct FileLoader
+{
+    const char *store;
+    size_t size;
+    size_t offset;        /* Bytes of the store already split in rows */
+
+    pthread_t thread;
+    bool started;
+    atomic_bool stop;
+    SpscQueue blocks;
+    int wake[2];
+
+    /* Written by the worker, read once it is done */
+    double scan_time;     /* Seconds spent looking for line feeds */
+    size_t invalid_utf8;  /* Invalid UTF-8 sequences found */
+};
+
+static double elapsedSince(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Find the line feeds in the next bytes of the store. The block is cut
+ * after its last line feed, so lines are never split, and it is grown
+ * when it doesn't contain any. */
+static int editorScanBlock(FileLoader *loader, size_t from, size_t bytes, LoadBlock *block)
+{
+    size_t to, count;
+
+    while (1)
+    {
+        to = (bytes < loader->size - from) ? from + bytes : loader->size;
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        count = scan_newlines(loader->store + from, to - from, &block->newlines);
+        loader->scan_time += elapsedSince(&start);
+
+        if (count == (size_t)-1)
+            return -1;
+
+        if (count > 0 || to == loader->size)
+            break;
+
+        free(block->newlines);
+        bytes *= 2;
+    }
+
+    if (to < loader->size)
+        to = from + block->newlines[count - 1] + 1;
+
+    block->from = from;
+    block->to = to;
+    block->count = count;
+
+    return 0;
+}
+
+static void *editorLoaderThread(void *arg)
+{
+    FileLoader *loader = arg;
+    size_t from = loader->offset;
+
+    while (from < loader->size && !atomic_load(&loader->stop))
+    {
+        LoadBlock *block = malloc(sizeof(LoadBlock));
+        if (!block)
+            return NULL; // TODO: handle memory error
+
+        if (editorScanBlock(loader, from, LOAD_CHUNK, block) != 0)
+        {
+            block->newlines = NULL;
+            block->count = (size_t)-1;
+        }
+        else
+        {
+            loader->invalid_utf8 += utf8_count_invalid(loader->store + block->from,
+                                                       block->to - block->from);
+            from = block->to;
+        }
+
+        /* The main thread is behind, wait for it */
+        while (!spsc_push(&loader->blocks, block))
+        {
+            if (atomic_load(&loader->stop))
+            {
+                free(block->newlines);
+                free(block);
+                return NULL;
+            }
+            nanosleep(&(struct timespec){0, 1000000}, NULL);
+        }
+
+        ssize_t ret = write(loader->wake[1], "", 1);
+        (void)ret; /* The pipe is full, the main thread has been woken already */
+
+        if (block->count == (size_t)-1)
+            break;
+    }
+
+    return NULL;
+}
+
+static void editorLoadBlock(TextBuffer *buf, LoadBlock *block)
+{
+    FileLoader *loader = buf->loader;
+
+    int ret = block->count == (size_t)-1 ? -1 :
+        editorAppendStoreLines(buf, block->from, block->to, block->newlines, block->count);
+    loader->offset = block->to;
+
+    free(block->newlines);
+    free(block);
+
+    if (ret != 0)
+    {
+        editorFatalError("Error loading file %s: out of memory\n", buf->file_path);
+        exit(EXIT_FAILURE);
+    }
+
+    if (loader->offset == loader->size)
+    {
+        editorStopLoading(buf);
+    }
+}
+
+/* Split in rows a block indexed by the worker, if one is ready */
+static bool editorLoadPoll(TextBuffer *buf)
+{
+    void *block;
+    if (!spsc_pop(&buf->loader->blocks, &block))
+        return false;
+
+    editorLoadBlock(buf, block);
+    return true;
+}
+
+static void editorDrainWakePipe(int fd)
+{
+    char drain[64];
+    while (read(fd, drain, sizeof(drain)) > 0);
+}
+
+/* Called by the main loop when the worker has queued a block. Only one
+ * block is split per wake up (the worker writes a byte for each of them),
+ * so the screen is refreshed and the keys are served in between. */
+static void editorLoadWake(int fd, void *data)
+{
+    char c;
+    if (read(fd, &c, 1) == 1)
+        editorLoadPoll(data);
+}
+
+void editorLoadAll(TextBuffer *buf)
+{
+    while (buf->loader != NULL)
+    {
+        if (editorLoadPoll(buf))
+            continue;
+
+        struct pollfd pfd = {.fd = buf->loader->wake[0], .events = POLLIN};
+        if (poll(&pfd, 1, -1) > 0)
+            editorDrainWakePipe(pfd.fd);
+    }
+}
+
+/* Return the percentage of the file already loaded, -1 if it is complete */
+int editorLoadProgress(TextBuffer *buf)
+{
+    if (buf->loader == NULL)
+        return -1;
+
+    return buf->loader->offset * 100 / buf->loader->size;
+}
+
+void editorStopLoading(TextBuffer *buf)
+{
+    FileLoader *loader = buf->loader;
+    if (loader == NULL)
+        return;
+
+    if (loader->started)
+    {
+        atomic_store(&loader->stop, true);
+        pthread_join(loader->thread, NULL);
+
+        void *block;
+        while (spsc_pop(&loader->blocks, &block))
+        {
+            free(((LoadBlock *)block)->newlines);
+            free(block);
+        }
+    }
+
+    if (loader->offset == loader->size && loader->scan_time > 0)
+    {
+        char invalid[48] = "";
+        if (loader->invalid_utf8 > 0)
+            snprintf(invalid, sizeof(invalid), ", %zu invalid UTF-8 sequences", loader->invalid_utf8);
+
+        editorFlashStatusMessage("\"%s\" %d lines, %zu bytes (indexed at %.2f GB/s, %s)%s",
+                               buf->filename, buf->numrows, loader->size,
+                               loader->size / loader->scan_time / 1e9,
+                               scan_newlines_impl(), invalid);
+    }
+
+    editorUnwatchFd(loader->wake[0]);
+    spsc_free(&loader->blocks);
+    close(loader->wake[0]);
+    close(loader->wake[1]);
+    free(loader);
+    buf->loader = NULL;
+}
+
+static int editorLoadStore(TextBuffer *buf, char *map, size_t size)
+{
+    editorSetStore(buf, map, size, true);
+    buf->dirty = false;
+
+    FileLoader *loader = calloc(1, sizeof(FileLoader));
+    if (loader == NULL)
+        return -1;
+
+    loader->store = map;
+    loader->size = size;
+    atomic_init(&loader->stop, false);
+
+    if (spsc_init(&loader->blocks, LOAD_QUEUE_SIZE) != 0)
+    {
+        free(loader);
+        return -1;
+    }
+
+    if (pipe(loader->wake) == -1)
+    {
+        spsc_free(&loader->blocks);
+        free(loader);
+        return -1;
+    }
+    fcntl(loader->wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(loader->wake[1], F_SETFL, O_NONBLOCK);
+
+    buf->loader = loader;
+
+    /* The first screen is loaded right away */
+    LoadBlock *first = malloc(sizeof(LoadBlock));
+    if (!first || editorScanBlock(loader, 0, LOAD_FIRST_CHUNK, first) != 0)
+    {
+        free(first);
+        editorStopLoading(buf);
+        return -1;
+    }
+    loader->invalid_utf8 = utf8_count_invalid(map, first->to);
+    editorLoadBlock(buf, first);
+
+    if (buf->loader == NULL)
+        return 0;
+
+    if (pthread_create(&loader->thread, NULL, editorLoaderThread, loader) != 0)
+    {
+        editorStopLoading(buf);
+        return -1;
+    }
+    loader->started = true;
+
+    /* No room left in the main loop, finish loading right away */
+    if (editorWatchFd(loader->wake[0], editorLoadWake, buf) != 0)
+        editorLoadAll(buf);
+
+    return 0;
+}
 
 int editorOpen(Window *W, const char *file_path)
 {
@@ -49,8 +352,8 @@ int editorOpen(Window *W, const char *file_path)
 
     editorSelectSyntaxHighlight(W->buf, W->buf->filename);
 
-    FILE *fp = fopen(file_path, "r");
-    if (!fp)
+    int fd = open(file_path, O_RDONLY);
+    if (fd == -1)
     {
         if (errno == ENOENT)
         {
@@ -64,6 +367,31 @@ int editorOpen(Window *W, const char *file_path)
         }
     }
 
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            close(fd);
+            if (editorLoadStore(buf, map, st.st_size) != 0)
+            {
+                editorFatalError("Error loading file %s\n", file_path);
+                return -1;
+            }
+            return 0;
+        }
+    }
+
+    /* Not a regular file (or mmap failed), read it line by line */
+    FILE *fp = fdopen(fd, "r");
+    if (!fp)
+    {
+        editorFatalError("Error opening file %s: %s\n", file_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
     char *line = NULL;
     size_t linecap = 0;
     ssize_t linelen;
@@ -85,15 +413,19 @@ int editorOpen(Window *W, const char *file_path)
     return 0;
 }
 
-static char *editorRowsToString(TextBuffer *buf, int *buflen)
+static char *editorRowsToString(TextBuffer *buf, size_t *buflen)
 {
     char *strbuf = NULL;
-    int totlen = 0;
-    int j;
+    size_t totlen = 0;
+    Row *row;
 
-    for (j = 0; j < buf->numrows; j++)
+    for (row = editorGetRow(buf, 0); row; row = editorRowNext(row))
     {
-        totlen += buf->rows[j].size + 1; /* +1 for '\0' */
+        /* +1 for '\0', and one more below for the nulterm */
+        if ((size_t)row->size > SIZE_MAX - 2 - totlen)
+            return NULL;
+
+        totlen += (size_t)row->size + 1;
     }
 
     *buflen = totlen;
@@ -106,10 +438,10 @@ static char *editorRowsToString(TextBuffer *buf, int *buflen)
     }
 
     char *p = strbuf;
-    for (j = 0; j < buf->numrows; j++)
+    for (row = editorGetRow(buf, 0); row; row = editorRowNext(row))
     {
-        memcpy(p, buf->rows[j].chars, buf->rows[j].size);
-        p += buf->rows[j].size;
+        memcpy(p, row->chars, row->size);
+        p += row->size;
         *p = '\n'; /* overwrite '\0' with '\n' */
         p++;
     }
@@ -123,35 +455,41 @@ int editorSave(TextBuffer *buf)
     int fd = open(buf->file_path, O_RDWR | O_CREAT, 0644); // 0644 = (rw-r--r--)
     if (fd == -1)
     {
-        editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+        editorFlashStatusMessage("Can't save! I/O error: %s", strerror(errno));
         return 1;
     }
 
-    int len;
+    /* The rows not loaded yet would be lost */
+    editorLoadAll(buf);
+
+    size_t len;
     char *strbuf = editorRowsToString(buf, &len);
     if (!strbuf)
     {
-        editorSetStatusMessage("Not enough memory!");
+        close(fd);
+        editorFlashStatusMessage("Not enough memory!");
         return 1;
     }
 
+    /* The rows may point into the mapped file we are about to overwrite,
+     * move them on the string we are writing, it holds the same text. */
+    editorRebaseRows(buf, strbuf, len + 1, false);
+
     /* TODO: improve this for safety reasons... */
-    if (ftruncate(fd, len) == -1)
+    if (ftruncate(fd, (off_t)len) == -1)
         goto writeerr;
     if (writen(fd, strbuf, len) == -1)
         goto writeerr;
 
     close(fd);
-    free(strbuf);
     buf->dirty = false;
-    editorSetStatusMessage("\"%s\" saved, %d bytes written on disk", buf->file_path, len);
+    editorFlashStatusMessage("\"%s\" saved, %zu bytes written on disk", buf->file_path, len);
     return 0;
 
 writeerr:
-    free(strbuf);
     if (fd != -1)
         close(fd);
-    editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+    editorFlashStatusMessage("Can't save! I/O error: %s", strerror(errno));
     return 1;
 }
 
@@ -9,12 +9,18 @@
 #include "core.h"
 #include "cursor.h"
 #include "textbuffer.h"
+#include "memsearch.h"
+#include "regexp.h"
+#include "vector.h"
+#include "workpool.h"
 
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdatomic.h>
+#include <limits.h>
 
 typedef enum FindDirection
 {
@@ -23,110 +29,591 @@ typedef enum FindDirection
     STAY_STILL = 0
 } FindDirection;
 
-typedef struct Match
-{
-    int x, y;
-} Match;
+/* Matches are drawn by the window as an overlay of its text */
+typedef HighlightRange Match;
 
-#define NO_MATCH (Match){-1,-1}
+#define NO_MATCH (Match){-1,-1,0}
 
-static void restoreHL(Row *row, unsigned char **saved_hl)
+/* A plain text query is its own prefix. A regex is looked for only in the
+ * rows holding the literal its matches start with, if it has one. */
+typedef struct FindQuery
+{
+    const char *text;
+    size_t len;
+    Regexp *re;        /* NULL when searching for plain text */
+    const char *prefix;
+    size_t prefix_len;
+} FindQuery;
+
+/* The search goes through the text of the rows, not their render, so
+ * that rows never drawn don't have to be rendered. Rows loaded from a
+ * file lie one after the other in the buffer store, split only by their
+ * line break: such runs are scanned at once, in blocks of up to
+ * FIND_BLOCK_MAX bytes, instead of one row at a time. The query can't
+ * contain line breaks, so it never matches across rows.
+ *
+ * Every match of the query is collected in an index sorted by position,
+ * so moving between them is a lookup. Big buffers are split in chunks of
+ * rows searched by the worker pool. Empty matches (a regex like "x*") are
+ * left out, there is nothing to show of them. */
+#define FIND_BLOCK_MAX (64 * 1024)
+#define FIND_PARALLEL_MIN_ROWS 16384
+#define FIND_CHUNKS_PER_THREAD 4
+#define FIND_MAX_MATCHES 1000000
+#define FIND_WALK_ROWS 16
+
+typedef struct MatchIndex
+{
+    Vector matches;  /* Match, sorted by row and then by column */
+    bool truncated;  /* FIND_MAX_MATCHES were found, the ones after are missing */
+    int first_row;   /* The rows above were not searched */
+    int numrows;     /* Rows of the buffer, more can be loaded meanwhile */
+} MatchIndex;
+
+/* Rows first..first+count searched by one task, or the matches of a
+ * shorter query when within is set. A regex has its own
+ * copy, automata are built while matching. */
+typedef struct SearchChunk
+{
+    const FindQuery *q;
+    Regexp *re;
+    TextBuffer *buf;
+    Row *first;
+    int count;
+    int y;           /* Index of first */
+    const Match *within;
+    size_t nwithin;
+    Vector matches;
+    atomic_size_t found;  /* Size of matches, for the chunks after */
+    bool full;
+} SearchChunk;
+
+/* Tell if the text of next starts right after end, past a line break */
+static bool followsInMemory(const char *end, const Row *next)
 {
-    if (*saved_hl)
+    if (next->chars <= end || next->chars - end > 2)
+        return false;
+
+    for (const char *p = end; p < next->chars; p++)
     {
-        memcpy(row->render.hl, *saved_hl, row->render.size);
-        free(*saved_hl);
-        *saved_hl = NULL;
-    }     
+        if (*p != '\n' && *p != '\r')
+            return false;
+    }
+
+    return next->chars[-1] == '\n';
 }
 
-static Match findForward(Window *W, const char *query, Match start_pos)
+static FindQuery findQuery(const char *text, Regexp *re)
 {
-    TextBuffer *buf = W->buf;
+    FindQuery q = {text, strlen(text), re, text, strlen(text)};
 
-    if (start_pos.y == -1)
-        return NO_MATCH;
+    if (re != NULL)
+        q.prefix = regexp_prefix(re, &q.prefix_len);
 
-    // Check for a match on the *current line* after the cursor
-    Row *row = &buf->rows[start_pos.y];
-    char *found = NULL;
-    if (start_pos.x + 1 < (int)row->render.size) // TODO: fix the cast
-    {
-        found = strstr(row->render.c + start_pos.x + 1, query);
-    }
+    return q;
+}
 
-    if (found)
+static bool validQuery(const FindQuery *q)
+{
+    if (q->re != NULL)
+        return true;
+
+    return q->len > 0 && !memchr(q->text, '\n', q->len) && !memchr(q->text, '\r', q->len);
+}
+
+/* Add the match at start..end of the row, y rows below the chunk's first.
+ * Returns false once the chunk is full. */
+static bool addMatch(SearchChunk *chunk, int y, size_t start, size_t end)
+{
+    if (end == start)
+        return true;
+
+    Match m = {(int)start, chunk->y + y, (int)(end - start)};
+    if (vector_push_back(&chunk->matches, &m) != 0)
     {
-        return (Match){(int)(found - row->render.c), start_pos.y};
+        // TODO: handle memory error
+        chunk->full = true;
+        return false;
     }
 
-    // If not found, search all subsequent lines
-    for (int i = 1; i <= buf->numrows; i++)
+    chunk->full = (vector_size(&chunk->matches) == FIND_MAX_MATCHES);
+    return !chunk->full;
+}
+
+/* Tell if the chunks before task found enough matches for the index */
+static bool enoughBefore(SearchChunk *chunks, size_t task)
+{
+    size_t found = 0;
+
+    for (size_t c = 0; c < task; c++)
+        found += atomic_load_explicit(&chunks[c].found, memory_order_relaxed);
+
+    return found >= FIND_MAX_MATCHES;
+}
+
+/* Collect the matches in the rows of a block, from row (y rows below the
+ * chunk's first) up to end. Returns false once the chunk is full. */
+static bool searchBlock(SearchChunk *chunk, Row *row, int y, const char *end)
+{
+    const FindQuery *q = chunk->q;
+    const char *from = row->chars;
+    int rows = 0;
+
+    for (;;)
     {
-        int next_y = (start_pos.y + i) % buf->numrows;
-        row = &buf->rows[next_y];
-        found = strstr(row->render.c, query);
-        if (found)
+        if (q->prefix_len > 0)
+        {
+            const char *p = mem_find(from, end - from, q->prefix, q->prefix_len);
+            if (p == NULL)
+                return true;
+
+            while (p >= row->chars + row->size)
+            {
+                row = editorRowNext(row);
+                rows++;
+            }
+            from = p > row->chars ? p : row->chars;
+
+            if (q->re == NULL)
+            {
+                if (!addMatch(chunk, y + rows, p - row->chars, p - row->chars + q->len))
+                    return false;
+
+                from = p + q->len;
+                continue;
+            }
+        }
+
+        size_t start, stop;
+        if (regexp_search(chunk->re, row->chars, row->size, from - row->chars, &start, &stop))
         {
-            return (Match){(int)(found - row->render.c), next_y};
+            if (!addMatch(chunk, y + rows, start, stop))
+                return false;
+
+            // Go on after the match, or past it if it was empty
+            from = row->chars + (stop > start ? stop : start + 1);
+            if (from <= row->chars + row->size)
+                continue;
         }
-    }
 
-    return NO_MATCH;
+        if (row->chars + row->size >= end)
+            return true;
+
+        row = editorRowNext(row);
+        rows++;
+        from = row->chars;
+    }
 }
 
-static Match findBackward(Window *W, const char *query, Match start_pos)
+/* Look for a plain text query only where the shorter one matched. Those
+ * matches don't overlap, and an occurrence left out lies inside the match
+ * before it: a longer query can only start inside one of them. Taking the
+ * first fit past the previous match, as the scan does, gives the same. */
+static void searchWithin(SearchChunk *chunk)
 {
-    TextBuffer *buf = W->buf;
-    if (start_pos.y == -1)
-        return NO_MATCH;
+    const FindQuery *q = chunk->q;
+    Row *row = NULL;
+    int y = -1;
+    int from = 0;
 
-    Row *row = &buf->rows[start_pos.y];
-    char *found = NULL;
-    char *last_match_on_line = NULL;
-    char *current_pos = row->render.c;
-
-    // Check for matches on the *current line* before the cursor
-    while ((found = strstr(current_pos, query)) != NULL)
+    for (size_t i = 0; i < chunk->nwithin; i++)
     {
-        if (found - row->render.c < start_pos.x)
+        const Match *m = &chunk->within[i];
+
+        if (m->y != y)
         {
-            last_match_on_line = found;
-            current_pos = found + 1;
+            // Close rows are quicker to reach by walking than from the root
+            if (row != NULL && m->y - y <= FIND_WALK_ROWS)
+            {
+                while (y < m->y)
+                {
+                    row = editorRowNext(row);
+                    y++;
+                }
+            }
+            else
+            {
+                row = editorGetRow(chunk->buf, m->y);
+                y = m->y;
+            }
+            from = 0;
         }
-        else
+
+        for (int x = m->x > from ? m->x : from; x < m->x + m->len && x + (int)q->len <= row->size; x++)
         {
-            break;
+            if (memcmp(row->chars + x, q->text, q->len) == 0)
+            {
+                if (!addMatch(chunk, y - chunk->y, x, x + q->len))
+                    return;
+
+                from = x + q->len;
+                break;
+            }
         }
     }
+}
 
-    if (last_match_on_line)
+static void searchChunk(void *arg, size_t task)
+{
+    SearchChunk *chunk = (SearchChunk *)arg + task;
+    Row *row = chunk->first;
+
+    if (chunk->within != NULL)
     {
-        return (Match){(int)(last_match_on_line - row->render.c), start_pos.y};
+        searchWithin(chunk);
+        return;
     }
 
-    // If not, search all previous lines
-    for (int i = 1; i <= buf->numrows; i++)
+    for (int y = 0; y < chunk->count && !enoughBefore(arg, task);)
     {
-        int prev_y = (start_pos.y - i + buf->numrows) % buf->numrows;
-        row = &buf->rows[prev_y];
+        Row *first = row;
+        const char *end = row->chars + row->size;
+        int rows = 1;
 
-        // Find the *last* match on this line
-        last_match_on_line = NULL;
-        current_pos = row->render.c;
-        while ((found = strstr(current_pos, query)) != NULL)
+        while (y + rows < chunk->count && end - first->chars < FIND_BLOCK_MAX &&
+               followsInMemory(end, editorRowNext(row)))
         {
-            last_match_on_line = found;
-            current_pos = found + 1;
+            row = editorRowNext(row);
+            end = row->chars + row->size;
+            rows++;
         }
 
-        if (last_match_on_line)
+        bool more = searchBlock(chunk, first, y, end);
+        atomic_store_explicit(&chunk->found, vector_size(&chunk->matches), memory_order_relaxed);
+        if (!more)
+            return;
+
+        y += rows;
+        row = editorRowNext(row);
+    }
+}
+
+static void freeMatchIndex(MatchIndex *index)
+{
+    vector_free(&index->matches);
+    index->truncated = false;
+}
+
+/* Search the chunks, on the worker pool if more than one, and put their
+ * matches in the index */
+static void runChunks(const FindQuery *q, SearchChunk *chunks, int num_chunks, MatchIndex *index)
+{
+    for (int c = 0; c < num_chunks; c++)
+    {
+        chunks[c].q = q;
+        chunks[c].re = q->re;
+        vector_init(&chunks[c].matches, Match);
+        atomic_init(&chunks[c].found, 0);
+
+        if (c > 0 && q->re != NULL)
+        {
+            const char *error;
+            chunks[c].re = regexp_compile(q->text, &error);
+            if (chunks[c].re == NULL)
+            {
+                editorFatalError("Fatal! Memory allocation for search failed\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    if (num_chunks > 1)
+        work_pool_run(searchChunk, chunks, num_chunks);
+    else
+        searchChunk(chunks, 0);
+
+    /* Chunks are in order: past a full one, the matches are too many */
+    for (int c = 0; c < num_chunks; c++)
+    {
+        size_t n = vector_size(&chunks[c].matches);
+        size_t room = FIND_MAX_MATCHES - vector_size(&index->matches);
+
+        if (!index->truncated)
         {
-            return (Match){(int)(last_match_on_line - row->render.c), prev_y};
+            /* Out of memory, the index ends here as if it were full */
+            size_t take = (n < room) ? n : room;
+            if (vector_reserve(&index->matches, vector_size(&index->matches) + take) != 0)
+                take = 0;
+
+            size_t i = 0;
+            while (i < take && vector_push_back(&index->matches, vector_at(&chunks[c].matches, i)) == 0)
+                i++;
+
+            index->truncated = chunks[c].full || i < n;
         }
+
+        vector_free(&chunks[c].matches);
+        if (chunks[c].re != q->re)
+            regexp_free(chunks[c].re);
     }
+}
 
-    return NO_MATCH;
+static int searchChunks(size_t work)
+{
+    if (work >= FIND_PARALLEL_MIN_ROWS && work_pool_threads() > 0)
+        return (work_pool_threads() + 1) * FIND_CHUNKS_PER_THREAD;
+
+    return 1;
+}
+
+/* Fill the index with every match of the query from row first_row on */
+static void searchAll(TextBuffer *buf, const FindQuery *q, MatchIndex *index, int first_row)
+{
+    SearchChunk chunks[(WORK_POOL_MAX_THREADS + 1) * FIND_CHUNKS_PER_THREAD];
+    int rows = buf->numrows - first_row;
+
+    vector_clear(&index->matches);
+    index->truncated = false;
+    index->first_row = first_row;
+    index->numrows = buf->numrows;
+
+    if (!validQuery(q) || rows <= 0)
+        return;
+
+    int num_chunks = searchChunks(rows);
+    int per_chunk = (rows + num_chunks - 1) / num_chunks;
+
+    for (int c = 0; c < num_chunks; c++)
+    {
+        int start = first_row + c * per_chunk;
+        int count = (start + per_chunk <= buf->numrows) ? per_chunk : buf->numrows - start;
+
+        chunks[c] = (SearchChunk){
+            .buf = buf,
+            .first = count > 0 ? editorGetRow(buf, start) : NULL,
+            .count = count > 0 ? count : 0,
+            .y = start
+        };
+    }
+
+    runChunks(q, chunks, num_chunks, index);
+}
+
+/* Fill the index with the matches of a plain text query that extends the
+ * one of prev, which hold all the places where they can start. Not for
+ * regexes: a longer pattern can match more ("a" then "a*"). */
+static void refineAll(TextBuffer *buf, const FindQuery *q, MatchIndex *prev, MatchIndex *index)
+{
+    SearchChunk chunks[(WORK_POOL_MAX_THREADS + 1) * FIND_CHUNKS_PER_THREAD];
+    const Match *m = vector_data(&prev->matches);
+    size_t n = vector_size(&prev->matches);
+
+    vector_clear(&index->matches);
+    index->truncated = false;
+    index->first_row = 0;
+    index->numrows = prev->numrows;
+
+    if (!validQuery(q))
+        return;
+
+    int num_chunks = searchChunks(n);
+    size_t per_chunk = (n + num_chunks - 1) / num_chunks;
+
+    /* The matches of a row all go to the same chunk, they depend on the
+     * ones before */
+    size_t start = 0;
+    for (int c = 0; c < num_chunks; c++)
+    {
+        size_t end = (c + 1) * per_chunk < n ? (c + 1) * per_chunk : n;
+        while (end < n && end > 0 && m[end].y == m[end - 1].y)
+            end++;
+        if (end < start)
+            end = start;
+
+        chunks[c] = (SearchChunk){
+            .buf = buf,
+            .within = m + start,
+            .nwithin = end - start
+        };
+        start = end;
+    }
+
+    runChunks(q, chunks, num_chunks, index);
+}
+
+/* The indexes of the queries typed so far, by length: they are all
+ * prefixes of the current one. Typing a char refines the index of the
+ * query before, backspace goes back to one already there. */
+typedef struct SearchCache
+{
+    MatchIndex results[EDITOR_QUERY_LEN + 1];
+    bool cached[EDITOR_QUERY_LEN + 1];
+    int numrows;  /* Rows of the buffer the indexes were built with */
+} SearchCache;
+
+static void initSearchCache(SearchCache *cache)
+{
+    cache->numrows = 0;
+
+    for (int i = 0; i <= EDITOR_QUERY_LEN; i++)
+    {
+        vector_init(&cache->results[i].matches, Match);
+        cache->results[i].truncated = false;
+        cache->results[i].first_row = 0;
+        cache->results[i].numrows = 0;
+        cache->cached[i] = false;
+    }
+}
+
+/* Forget the indexes of the queries of len chars or more */
+static void dropSearchCache(SearchCache *cache, int len)
+{
+    for (int i = len; i <= EDITOR_QUERY_LEN; i++)
+    {
+        if (cache->cached[i])
+            freeMatchIndex(&cache->results[i]);
+        cache->cached[i] = false;
+    }
+}
+
+/* The index of the query of len chars */
+static MatchIndex *searchCached(SearchCache *cache, TextBuffer *buf, const FindQuery *q, int len)
+{
+    MatchIndex *index = &cache->results[len];
+    MatchIndex *prev = &cache->results[len - 1];
+
+    /* Rows loaded since then can hold matches none of them has */
+    if (cache->numrows != buf->numrows)
+    {
+        dropSearchCache(cache, 0);
+        cache->numrows = buf->numrows;
+    }
+
+    if (cache->cached[len])
+        return index;
+
+    if (len > 1 && cache->cached[len - 1] && q->re == NULL &&
+        !prev->truncated && prev->first_row == 0)
+        refineAll(buf, q, prev, index);
+    else
+        searchAll(buf, q, index, 0);
+
+    cache->cached[len] = true;
+    return index;
+}
+
+/* Position in the index of the first match starting after x of row y,
+ * the size of the index when there are none */
+static size_t matchAfter(MatchIndex *index, int x, int y)
+{
+    const Match *m = vector_data(&index->matches);
+    size_t lo = 0, hi = vector_size(&index->matches);
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (m[mid].y < y || (m[mid].y == y && m[mid].x <= x))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* Tell if the row holds a match starting before x. The row is scanned
+ * from x down, so the search stops at the last match before it. */
+static bool matchBefore(TextBuffer *buf, const FindQuery *q, Row *row, int r, int x)
+{
+    /* Matches start before limit, at the end of the row at the latest */
+    size_t limit = (x <= 0) ? 0 : (x <= row->size) ? (size_t)x : (size_t)row->size + 1;
+    if (limit == 0)
+        return false;
+
+    if (q->re == NULL)
+    {
+        /* The match may end up to len - 1 bytes past its start */
+        size_t n = limit - 1 + q->len;
+        return mem_rfind(row->chars, n < (size_t)row->size ? n : (size_t)row->size,
+                         q->text, q->len) != NULL;
+    }
+
+    size_t start, end;
+    if (!regexp_search_last(q->re, row->chars, row->size, limit, &start, &end))
+        return false;
+
+    if (end > start)
+        return true;
+
+    /* An empty match is left out of the index, but a longer one could start
+     * before it: look at the row the way the index does */
+    SearchChunk chunk = {.q = q, .re = q->re, .buf = buf, .first = row, .count = 1, .y = r};
+    vector_init(&chunk.matches, Match);
+    atomic_init(&chunk.found, 0);
+
+    searchChunk(&chunk, 0);
+
+    bool found = vector_size(&chunk.matches) > 0 && ((Match *)vector_at(&chunk.matches, 0))->x < x;
+    vector_free(&chunk.matches);
+
+    return found;
+}
+
+/* The nearest row from y up holding a match that starts before x there,
+ * or -1. Only needed when the index doesn't reach that far. */
+static int rowWithMatchAbove(TextBuffer *buf, const FindQuery *q, int x, int y)
+{
+    Row *row = editorGetRow(buf, y);
+
+    for (int r = y; r >= 0; r--, row = editorRowPrev(row))
+    {
+        if (matchBefore(buf, q, row, r, r < y ? INT_MAX : x))
+            return r;
+    }
+
+    return -1;
+}
+
+/* Position of the first match after x of row y, wrapping around to the
+ * first one of the buffer. An index that starts below y, or that was cut
+ * at FIND_MAX_MATCHES before y, is built again from there. */
+static size_t seekForward(TextBuffer *buf, const FindQuery *q, MatchIndex *index, int x, int y)
+{
+    size_t pos = matchAfter(index, x, y);
+
+    if (y < index->first_row || (pos == vector_size(&index->matches) && index->truncated))
+    {
+        searchAll(buf, q, index, y);
+        pos = matchAfter(index, x, y);
+    }
+
+    if (pos == vector_size(&index->matches) && index->first_row > 0)
+    {
+        /* Wrap around to the first match of the rebuilt index */
+        searchAll(buf, q, index, 0);
+        return 0;
+    }
+
+    return pos < vector_size(&index->matches) ? pos : 0;
+}
+
+/* Position of the last match starting before x of row y, wrapping around
+ * to the last one of the buffer. When the index doesn't hold it, the rows
+ * above are searched for the nearest one with a match, and the index is
+ * built again from there. */
+static size_t seekBackward(TextBuffer *buf, const FindQuery *q, MatchIndex *index, int x, int y)
+{
+    size_t n = vector_size(&index->matches);
+    size_t pos = matchAfter(index, x - 1, y);
+
+    if (y >= index->first_row && pos > 0 && (pos < n || !index->truncated))
+        return pos - 1;
+
+    if (index->first_row == 0 && !index->truncated)
+        return n > 0 ? n - 1 : 0;
+
+    int r = rowWithMatchAbove(buf, q, x, y);
+    if (r >= 0)
+    {
+        searchAll(buf, q, index, r);
+        return matchAfter(index, x - 1, y) - 1;
+    }
+
+    r = rowWithMatchAbove(buf, q, INT_MAX, buf->numrows - 1);
+    searchAll(buf, q, index, r >= 0 ? r : 0);
+
+    n = vector_size(&index->matches);
+    return n > 0 ? n - 1 : 0;
 }
 
 void editorFind(Window *W, int fd)
@@ -146,13 +633,16 @@ void editorFind(Window *W, int fd)
     }
 
     Match match = NO_MATCH;
-    Match search_start_pos = (Match){saved_cx, saved_cy};
     FindDirection d = STAY_STILL;
-    
-    int saved_hl_line = -1;
-    unsigned char *saved_hl = NULL;
-    
-    const char *prompt_prefix = "Search: ";
+
+    SearchCache cache;
+    MatchIndex *index = &cache.results[0];
+    size_t current = 0;
+    bool rescan = true;
+
+    Regexp *re = NULL;
+    const char *re_error = NULL;
+    bool recompile = true;
 
     if (buf->numrows == 0)
     {
@@ -160,10 +650,28 @@ void editorFind(Window *W, int fd)
         return;
     }
 
+    initSearchCache(&cache);
+
     while (1)
     {
-        editorSetStatusMessage("%s%s (ESC=Cancel, ENTER=Confirm, Arrows=Navigate)", 
-                               prompt_prefix, query);
+        const char *prompt_prefix = E.search_regex ? "Regex: " : "Search: ";
+        size_t found = vector_size(&index->matches);
+        char count[64] = "";
+
+        if (qlen > 0 && !re_error && !rescan)
+        {
+            if (found == 0)
+                snprintf(count, sizeof(count), " [no matches]");
+            else
+                snprintf(count, sizeof(count), " [%zu of %zu%s]", current + 1, found,
+                         index->truncated ? "+" : "");
+        }
+
+        if (re_error)
+            editorSetStatusMessage("%s%s (%s)", prompt_prefix, query, re_error);
+        else
+            editorSetStatusMessage("%s%s%s (ESC=Cancel, ENTER=Confirm, Arrows=Navigate, Ctrl+R=Regex)",
+                                   prompt_prefix, query, count);
         
         editorRefreshScreen();
 
@@ -182,14 +690,14 @@ void editorFind(Window *W, int fd)
         case BACKSPACE:
             if (qlen != 0)
                 query[--qlen] = '\0';
+            recompile = true;
             
-            // Reset search
+            // Search again, from the original position
             match = NO_MATCH;
-            search_start_pos = (Match){saved_cx, saved_cy}; // Start from original pos
-            d = FIND_NEXT; // Trigger a new search
+            rescan = true;
+            d = FIND_NEXT;
 
-            restoreHL(saved_hl_line >= 0 ? &buf->rows[saved_hl_line] : NULL, &saved_hl);
-            saved_hl_line = -1;
+            windowClearOverlay(W);
             break;
             
         case ESC:
@@ -198,7 +706,9 @@ void editorFind(Window *W, int fd)
             W->viewport.coloff = saved_coloff;
             W->viewport.rowoff = saved_rowoff;
             
-            restoreHL(saved_hl_line >= 0 ? &buf->rows[saved_hl_line] : NULL, &saved_hl);
+            windowClearOverlay(W);
+            regexp_free(re);
+            dropSearchCache(&cache, 0);
             editorSetStatusMessage("");
             return;
             
@@ -210,7 +720,9 @@ void editorFind(Window *W, int fd)
                 W->viewport.coloff = saved_coloff;
                 W->viewport.rowoff = saved_rowoff;
                 
-                restoreHL(saved_hl_line >= 0 ? &buf->rows[saved_hl_line] : NULL, &saved_hl);
+                windowClearOverlay(W);
+                regexp_free(re);
+                dropSearchCache(&cache, 0);
                 editorSetStatusMessage("");
 
                 return;
@@ -221,24 +733,33 @@ void editorFind(Window *W, int fd)
                 free(E.last_search);
                 E.last_search = strdup(query);
             }
-            restoreHL(saved_hl_line >= 0 ? &buf->rows[saved_hl_line] : NULL, &saved_hl);
+            windowClearOverlay(W);
+            regexp_free(re);
+            dropSearchCache(&cache, 0);
             
             editorSetStatusMessage("");
 
             return;
+
+        case CTRL_R:
+            E.search_regex = !E.search_regex;
+            recompile = true;
+
+            match = NO_MATCH;
+            rescan = true;
+            d = FIND_NEXT;
+            windowClearOverlay(W);
+            dropSearchCache(&cache, 0);
+            break;
             
         case ARROW_RIGHT:
         case ARROW_DOWN:
             d = FIND_NEXT;
-            // Start next search from the last match
-            if (match.y != -1) search_start_pos = match;
             break;
             
         case ARROW_LEFT:
         case ARROW_UP:
             d = FIND_PREVIOUS;
-            // Start prev search from the last match
-            if (match.y != -1) search_start_pos = match;
             break;
             
         default:
@@ -248,12 +769,15 @@ void editorFind(Window *W, int fd)
                 {
                     query[qlen++] = c;
                     query[qlen] = '\0';
+                    recompile = true;
+
+                    // The indexes of the longer queries were for other chars
+                    windowClearOverlay(W);
+                    dropSearchCache(&cache, qlen);
 
                     match = NO_MATCH;
-                    search_start_pos = (Match){saved_cx, saved_cy};
+                    rescan = true;
                     d = FIND_NEXT;
-                    restoreHL(saved_hl_line >= 0 ? &buf->rows[saved_hl_line] : NULL, &saved_hl);
-                    saved_hl_line = -1;
                 }
             }
             else
@@ -263,38 +787,51 @@ void editorFind(Window *W, int fd)
             break;
         }
 
-        if (qlen == 0 || d == STAY_STILL)
+        if (recompile)
+        {
+            regexp_free(re);
+            re = NULL;
+            re_error = NULL;
+            if (E.search_regex && qlen > 0)
+                re = regexp_compile(query, &re_error);
+            recompile = false;
+        }
+
+        if (qlen == 0 || d == STAY_STILL || re_error)
         {
             continue;
         }
-        
-        // Restore highlight from *previous* match before finding next
-        restoreHL(saved_hl_line >= 0 ? &buf->rows[saved_hl_line] : NULL, &saved_hl);
-        saved_hl_line = -1;
 
-        if (d == FIND_NEXT)
+        FindQuery q = findQuery(query, re);
+        if (rescan)
         {
-            match = findForward(W, query, search_start_pos);
+            index = searchCached(&cache, buf, &q, qlen);
+
+            // The first match after the original position
+            current = seekForward(buf, &q, index, saved_cx, saved_cy);
+            rescan = false;
         }
-        else if (d == FIND_PREVIOUS)
+        else if (match.y != -1)
         {
-            match = findBackward(W, query, search_start_pos);
+            // Rows loaded since the index was built can hold more matches
+            if (index->numrows != buf->numrows)
+                searchAll(buf, &q, index, index->first_row);
+
+            if (d == FIND_NEXT)
+                current = seekForward(buf, &q, index, match.x, match.y);
+            else if (d == FIND_PREVIOUS)
+                current = seekBackward(buf, &q, index, match.x, match.y);
         }
 
+        if (vector_size(&index->matches) > 0)
+            match = *(Match *)vector_at(&index->matches, current);
+        else
+            match = NO_MATCH;
+
+        windowSetOverlay(W, vector_data(&index->matches), vector_size(&index->matches), current);
+
         if (match.y != -1)
         {
-            Row *row = &buf->rows[match.y];
-    
-            saved_hl_line = match.y;
-            saved_hl = malloc(row->render.size);
-            if (!saved_hl)
-            {
-                editorFatalError("Fatal! Memory allocation for highlight failed\n");
-                exit(EXIT_FAILURE);
-            }
-            memcpy(saved_hl, row->render.hl, row->render.size);
-            memset(row->render.hl + match.x, HL_MATCH, strlen(query));
-
             W->cy = match.y;
             W->viewport.rowoff = 0;
             W->cx = match.x;
@@ -308,14 +845,32 @@ void editorFind(Window *W, int fd)
     }
 }
 
+/* find [-r] [query], -r searches for a regex */
 void command_handler_find(int fd, int argc, char **argv)
 {
+    bool regex = (argc != 0 && strcmp(argv[0], "-r") == 0);
+    if (regex)
+    {
+        argc--;
+        argv++;
+    }
+
+    if (argc > 1)
+    {
+        editorSetStatusMessage("Error: too many arguments for 'find'.");
+        return;
+    }
+
     if (argc != 0)
     {
         free(E.last_search);
         E.last_search = strdup(argv[0]);
     }
 
+    /* A plain find goes back to plain text, unless only reopening the prompt */
+    if (regex || argc != 0)
+        E.search_regex = regex;
+
     editorFind(E.active_win, fd);
 }
 
@@ -34,7 +34,7 @@ typedef struct ShellAlias
 
 static const ShellCommand BUILTIN_COMMANDS[] = {
     {"quit",    command_handler_quit,       0, 0},
-    {"find",    command_handler_find,       0, 1},
+    {"find",    command_handler_find,       0, 2},
     {"line",    command_handler_line,       0, 0},
     {"save",    command_handler_save,       0, 1},
     {"open",    command_handler_open,       0, 0},
@@ -123,13 +123,13 @@ static int commandExec(int fd, const char *command, int len)
 
             if (handler_argc < cmd->min_args)
             {
-                editorSetStatusMessage("Error: not enough arguments for '%s'.", cmd->name);
+                editorFlashStatusMessage("Error: not enough arguments for '%s'.", cmd->name);
                 break;
             }
 
             if (cmd->max_args != -1 && handler_argc > cmd->max_args)
             {
-                editorSetStatusMessage("Error: too many arguments for '%s'.", cmd->name);
+                editorFlashStatusMessage("Error: too many arguments for '%s'.", cmd->name);
                 break;
             }
 
@@ -140,7 +140,7 @@ static int commandExec(int fd, const char *command, int len)
 
     if (!found)
     {
-        editorSetStatusMessage("Error: Command not found: '%s'.", cmd_name);
+        editorFlashStatusMessage("Error: Command not found: '%s'.", cmd_name);
     }
 
     free(cmd_copy);
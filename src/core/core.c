@@ -5,83 +5,309 @@
 #include "event.h"
 #include "syntax.h"
 #include "textbuffer.h"
+#include "rowtree.h"
 
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
-void editorInsertRow(TextBuffer *buf, int at, char *s, size_t len)
+Row *editorGetRow(TextBuffer *buf, int at)
 {
-    if (!buf || at > buf->numrows)
-        return;
+    if (!buf || at < 0 || at >= buf->numrows)
+        return NULL;
+
+    return rowTreeAt(buf->root, at);
+}
+
+Row *editorRowNext(Row *row)
+{
+    return row ? rowTreeNext(row) : NULL;
+}
+
+Row *editorRowPrev(Row *row)
+{
+    return row ? rowTreePrev(row) : NULL;
+}
 
-    // TODO: meh
-    Row *new_rows = realloc(buf->rows, sizeof(Row) * (buf->numrows + 1));
-    if (!new_rows)
+int editorRowIndex(Row *row)
+{
+    return row ? rowTreeIndex(row) : -1;
+}
+
+/* Rows loaded from a file don't own their text: chars points straight
+ * into the buffer store (usually the mmap()ed file) and it is not null
+ * terminated. The text is copied on the heap the first time the row
+ * gets modified. */
+static bool rowIsShared(TextBuffer *buf, Row *row)
+{
+    return buf->store != NULL &&
+           row->chars >= buf->store &&
+           row->chars < buf->store + buf->store_size;
+}
+
+static int rowMakeWritable(TextBuffer *buf, Row *row)
+{
+    if (!rowIsShared(buf, row))
+        return 0;
+
+    char *copy = malloc(row->size + 1);
+    if (!copy)
     {
         // TODO: handle memory error
-        return;
+        return -1;
     }
-    buf->rows = new_rows;
 
-    if (at < buf->numrows)
+    memcpy(copy, row->chars, row->size);
+    copy[row->size] = '\0';
+    row->chars = copy;
+
+    return 0;
+}
+
+/* Rows freed from a slab are kept in a list (linked through left) and
+ * reused before asking malloc() for a new one. */
+static Row *editorAllocRow(TextBuffer *buf)
+{
+    Row *row = buf->free_rows;
+    if (row)
     {
-        /* Shift everything down by one */
-        memmove(&buf->rows[at + 1], &buf->rows[at], sizeof(Row) * (buf->numrows - at));
-        
-        for (int j = at + 1; j <= buf->numrows; j++)
-            buf->rows[j].idx++;
+        buf->free_rows = row->left;
+        return row;
     }
 
-    Row *row = &buf->rows[at];
+    row = malloc(sizeof(Row));
+    if (row)
+        row->flags = 0;
 
-    row->idx = at;
-    row->size = len;
-    row->chars = malloc(len + 1);
-    if (!row->chars)
+    return row;
+}
+
+/* Link a new row to the tree. It is rendered and highlighted the first
+ * time it is needed. */
+static Row *editorLinkRow(TextBuffer *buf, int at, char *chars, size_t len)
+{
+    Row *row = editorAllocRow(buf);
+    if (!row)
     {
         // TODO: handle memory error
-        return;
+        return NULL;
     }
-    memcpy(row->chars, s, len + 1);
 
+    row->size = len;
+    row->flags = (row->flags & ROW_SLAB) | ROW_HL_STALE;
+    row->hl_state = HL_STATE_UNKNOWN;
+    row->chars = chars;
     row->render = RENDER_NULL;
-    editorUpdateRow(buf, at);
+    editorRowChanged(row);
 
+    rowTreeInsert(&buf->root, at, row);
     buf->numrows++;
+
+    return row;
+}
+
+static Row *editorCreateRow(TextBuffer *buf, int at, char *chars, size_t len)
+{
+    Row *row = editorLinkRow(buf, at, chars, len);
+    if (!row)
+        return NULL;
+
+    editorUpdateSyntax(buf, row);
+
     buf->dirty = true;
+
+    return row;
 }
 
-static void editorFreeRow(Row *row)
+void editorInsertRow(TextBuffer *buf, int at, char *s, size_t len)
 {
-    free(row->chars);
+    if (!buf || at > buf->numrows)
+        return;
+
+    char *chars = malloc(len + 1);
+    if (!chars)
+    {
+        // TODO: handle memory error
+        return;
+    }
+    memcpy(chars, s, len);
+    chars[len] = '\0';
+
+    if (editorCreateRow(buf, at, chars, len) == NULL)
+        free(chars);
+}
+
+/* Append the lines of the store range [from, to) at the end of the buffer.
+ * newlines holds the offsets (relative to from) of the count line feeds
+ * inside the range, a last line without one is added as well. All the rows are allocated in a
+ * single slab and linked to the tree at once. */
+int editorAppendStoreLines(TextBuffer *buf, size_t from, size_t to,
+                           const size_t *newlines, size_t count)
+{
+    size_t last = count ? from + newlines[count - 1] + 1 : from;
+    size_t n = count + (last < to);
+    if (n == 0)
+        return 0;
+
+    Row *slab = malloc(n * sizeof(Row));
+    if (!slab)
+    {
+        // TODO: handle memory error
+        return -1;
+    }
+
+    if (vector_push_back(&buf->slabs, &slab) != 0)
+    {
+        free(slab);
+        // TODO: handle memory error
+        return -1;
+    }
+
+    size_t start = from;
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t end = i < count ? from + newlines[i] : to;
+        size_t len = end - start;
+
+        while (len > 0 && buf->store[start + len - 1] == '\r')
+        {
+            len--;
+        }
+
+        slab[i].size = len;
+        slab[i].flags = ROW_SLAB | ROW_HL_STALE;
+        slab[i].hl_state = HL_STATE_UNKNOWN;
+        slab[i].chars = buf->store + start;
+        slab[i].render = RENDER_NULL;
+        editorRowChanged(&slab[i]);
+
+        start = end + 1;
+    }
+
+    rowTreeJoin(&buf->root, rowTreeBuild(slab, n));
+    buf->numrows += n;
+
+    /* The rows are rendered when drawn, just move the highlight frontier
+     * above them */
+    editorUpdateSyntax(buf, slab);
+
+    return 0;
+}
+
+static void editorFreeRow(TextBuffer *buf, Row *row)
+{
+    if (!rowIsShared(buf, row))
+        free(row->chars);
     freeRender(&row->render);
+
+    if (row->flags & ROW_SLAB)
+    {
+        row->left = buf->free_rows;
+        buf->free_rows = row;
+    }
+    else
+    {
+        free(row);
+    }
 }
 
 void editorDelRow(TextBuffer *buf, int at)
 {
-    if (!buf || at >= buf->numrows)
+    Row *row = editorGetRow(buf, at);
+    if (!row)
         return;
-    
-    Row *row = &buf->rows[at];
-    editorFreeRow(row);
 
-    memmove(&buf->rows[at], &buf->rows[at + 1], sizeof(Row) * (buf->numrows - at - 1));
+    Row *next = editorRowNext(row);
 
-    buf->numrows--;
+    rowTreeRemove(&buf->root, row);
+    editorFreeRow(buf, row);
+
+    /* The next row now follows a different one */
+    if (next)
+        editorUpdateSyntax(buf, next);
 
-    for (int j = at; j < buf->numrows; j++)
-        buf->rows[j].idx++;
+    buf->numrows--;
     
     buf->dirty = true;
 }
 
-void editorRowInsertChar(TextBuffer *buf, int row_idx, int at, int c)
+static void freeRowSubtree(TextBuffer *buf, Row *t)
 {
-    if (!buf || row_idx < 0 || row_idx >= buf->numrows)
+    if (!t)
         return;
 
-    Row *row = &buf->rows[row_idx];
+    freeRowSubtree(buf, t->left);
+    freeRowSubtree(buf, t->right);
+    editorFreeRow(buf, t);
+}
+
+static void editorReleaseStore(TextBuffer *buf)
+{
+    if (buf->store == NULL)
+        return;
+
+    if (buf->store_mapped)
+        munmap(buf->store, buf->store_size);
+    else
+        free(buf->store);
+
+    buf->store = NULL;
+    buf->store_size = 0;
+    buf->store_mapped = false;
+}
+
+void editorFreeRows(TextBuffer *buf)
+{
+    freeRowSubtree(buf, buf->root);
+    buf->root = NULL;
+    buf->numrows = 0;
+
+    for (size_t i = 0; i < vector_size(&buf->slabs); i++)
+    {
+        free(*(Row **)vector_at(&buf->slabs, i));
+    }
+    vector_free(&buf->slabs);
+    buf->free_rows = NULL;
+    buf->hl_frontier = 0;
+
+    editorReleaseStore(buf);
+}
+
+void editorSetStore(TextBuffer *buf, char *store, size_t size, bool mapped)
+{
+    editorReleaseStore(buf);
+
+    buf->store = store;
+    buf->store_size = size;
+    buf->store_mapped = mapped;
+}
+
+/* Make every row point into a new store that holds the whole buffer text,
+ * laid out as the rows separated by a single byte (what editorSave writes
+ * on disk). The rows copied on the heap are given back and the previous
+ * store is released. */
+void editorRebaseRows(TextBuffer *buf, char *store, size_t size, bool mapped)
+{
+    char *p = store;
+
+    for (Row *row = editorGetRow(buf, 0); row; row = editorRowNext(row))
+    {
+        if (!rowIsShared(buf, row))
+            free(row->chars);
+
+        row->chars = p;
+        p += row->size + 1;
+    }
+
+    editorSetStore(buf, store, size, mapped);
+}
+
+void editorRowInsertChar(TextBuffer *buf, int row_idx, int at, int c)
+{
+    Row *row = editorGetRow(buf, row_idx);
+    if (!row || rowMakeWritable(buf, row) == -1)
+        return;
 
     if (at > row->size)
     {
@@ -114,7 +340,7 @@ void editorRowInsertChar(TextBuffer *buf, int row_idx, int at, int c)
 
     row->chars[at] = c;
 
-    editorUpdateRow(buf, row_idx);
+    editorUpdateRow(buf, row);
 
     buf->dirty = true;
 }
@@ -129,11 +355,10 @@ char editorRowGetChar(Row *row, int at)
 
 void editorRowAppendString(TextBuffer *buf, int row_idx, char *s, size_t len)
 {
-    if (!buf || row_idx < 0 || row_idx >= buf->numrows)
+    Row *row = editorGetRow(buf, row_idx);
+    if (!row || rowMakeWritable(buf, row) == -1)
         return;
 
-    Row *row = &buf->rows[row_idx];
-
     char *new_chars = realloc(row->chars, row->size + len + 1);
     if (!new_chars)
     {
@@ -146,43 +371,181 @@ void editorRowAppendString(TextBuffer *buf, int row_idx, char *s, size_t len)
     row->size += len;
     row->chars[row->size] = '\0';
 
-    editorUpdateRow(buf, row_idx);
+    editorUpdateRow(buf, row);
     
     buf->dirty = true;
 }
 
+/* Return the length of the first line of s. *next is set to the offset
+ * of the following line, a line ends with LF, CR or CR LF. */
+static size_t textLineLength(const char *s, size_t len, size_t *next)
+{
+    size_t i = 0;
+    while (i < len && s[i] != '\n' && s[i] != '\r')
+        i++;
+
+    *next = i;
+    if (i < len)
+        *next += (s[i] == '\r' && i + 1 < len && s[i + 1] == '\n') ? 2 : 1;
+
+    return i;
+}
+
+/* Insert a block of text at position at of the row row_idx. The text is
+ * split in lines in a single pass, only the row it starts on is rendered
+ * right away: the new rows are rendered and highlighted once, when they
+ * are drawn. The position right after the inserted text is stored in *end_row and
+ * *end_col. */
+void editorInsertText(TextBuffer *buf, int row_idx, int at, const char *s,
+                      size_t len, int *end_row, int *end_col)
+{
+    *end_row = row_idx;
+    *end_col = at;
+
+    if (!buf || row_idx < 0 || at < 0)
+        return;
+
+    while (buf->numrows <= row_idx)
+        editorInsertRow(buf, buf->numrows, "", 0);
+
+    Row *row = editorGetRow(buf, row_idx);
+    if (!row || rowMakeWritable(buf, row) == -1)
+        return;
+
+    size_t next;
+    size_t first = textLineLength(s, len, &next);
+
+    /* Past the end of the line the gap is filled with spaces */
+    int head = at < row->size ? at : row->size;
+    size_t pad = at - head;
+    size_t tail_len = row->size - head;
+
+    if (first == len)
+    {
+        char *new_chars = realloc(row->chars, row->size + pad + len + 1);
+        if (!new_chars)
+        {
+            // TODO: handle memory error
+            return;
+        }
+        row->chars = new_chars;
+
+        memmove(row->chars + at + len, row->chars + head, tail_len + 1);
+        memset(row->chars + head, ' ', pad);
+        memcpy(row->chars + at, s, len);
+        row->size += pad + len;
+
+        editorUpdateRow(buf, row);
+
+        *end_col = at + len;
+        buf->dirty = true;
+        return;
+    }
+
+    /* The end of the line goes after the last line of the text */
+    char *tail = malloc(tail_len + 1);
+    if (!tail)
+    {
+        // TODO: handle memory error
+        return;
+    }
+    memcpy(tail, row->chars + head, tail_len);
+
+    char *new_chars = realloc(row->chars, at + first + 1);
+    if (!new_chars)
+    {
+        // TODO: handle memory error
+        free(tail);
+        return;
+    }
+    row->chars = new_chars;
+
+    memset(row->chars + head, ' ', pad);
+    memcpy(row->chars + at, s, first);
+    row->size = at + first;
+    row->chars[row->size] = '\0';
+
+    int idx = row_idx;
+    size_t line_len = 0;
+    size_t pos = next;
+
+    while (1)
+    {
+        line_len = textLineLength(s + pos, len - pos, &next);
+        bool is_last = (pos + line_len == len);
+        size_t size = line_len + (is_last ? tail_len : 0);
+
+        char *chars = malloc(size + 1);
+        if (!chars)
+        {
+            // TODO: handle memory error
+            break;
+        }
+        memcpy(chars, s + pos, line_len);
+        if (is_last)
+            memcpy(chars + line_len, tail, tail_len);
+        chars[size] = '\0';
+
+        if (editorLinkRow(buf, idx + 1, chars, size) == NULL)
+        {
+            free(chars);
+            break;
+        }
+
+        idx++;
+
+        if (is_last)
+            break;
+        pos += next;
+    }
+
+    free(tail);
+
+    /* The new rows are rendered when needed, only the first is done now
+     * (it also moves the highlight frontier above the others) */
+    editorUpdateRow(buf, row);
+
+    *end_row = idx;
+    *end_col = line_len;
+    buf->dirty = true;
+}
+
 void editorRowDelChar(TextBuffer *buf, int row_idx, int at)
 {
-    if (!buf || row_idx < 0 || row_idx >= buf->numrows)
+    Row *row = editorGetRow(buf, row_idx);
+    if (!row || at >= row->size)
         return;
 
-    Row *row = &buf->rows[row_idx];
-    
-    if (at >= row->size)
+    if (rowMakeWritable(buf, row) == -1)
         return;
     
     memmove(row->chars + at, row->chars + at + 1, row->size - at);
     row->size--;
     
-    editorUpdateRow(buf, row_idx);
+    editorUpdateRow(buf, row);
     
     buf->dirty = true;
 }
 
 void editorRowDelChunk(TextBuffer *buf, int row_idx, int from, int to)
 {
-    if (!buf || row_idx < 0 || row_idx >= buf->numrows || from < 0)
+    Row *row = editorGetRow(buf, row_idx);
+    if (!row || from < 0)
         return;
-
-    Row *row = &buf->rows[row_idx];
     
     if (from >= row->size || to <= from)
         return;
+
+    if (to > row->size)
+        to = row->size;
+
+    if (rowMakeWritable(buf, row) == -1)
+        return;
     
-    memmove(row->chars + from, row->chars + to, row->size - from);
+    memmove(row->chars + from, row->chars + to, row->size - to + 1);
     row->size -= to - from;
     
-    editorUpdateRow(buf, row_idx);
+    editorUpdateRow(buf, row);
     
     buf->dirty = true;
 }
@@ -3,23 +3,46 @@
 
 #include "render.h"
 #include <stddef.h>
+#include <stdbool.h>
 
 typedef struct TextBuffer TextBuffer;
 
-// TODO: reimplement all of this using a better data structure
+#define ROW_SLAB (1 << 0)      /* Allocated in a slab, can't be freed on its own */
+#define ROW_HL_STALE (1 << 1)  /* Highlight out of date, redone when drawn */
+#define ROW_HL_LOSSY (1 << 2)  /* Highlight painted over tab or invalid marks */
+
 typedef struct Row
 {
-    int idx;
     int size;
-    char *chars;       /* null terminated */
+    unsigned char flags;
+    unsigned char hl_state; /* Lexer state at the end of the row (see syntax.h) */
+    char *chars;       /* null terminated, unless shared with the buffer store */
     RenderRow render;
+    unsigned int gen;  /* Changes every time render is modified */
+
+    /* Line tree links (see rowtree.h) */
+    struct Row *left, *right, *parent;
+    int count;         /* Number of rows in the subtree rooted here */
 } Row;
 
+Row *editorGetRow(TextBuffer *buf, int at);
+Row *editorRowNext(Row *row);
+Row *editorRowPrev(Row *row);
+int editorRowIndex(Row *row);
+
 void editorInsertRow(TextBuffer *buf, int at, char *s, size_t len);
+int editorAppendStoreLines(TextBuffer *buf, size_t from, size_t to,
+                           const size_t *newlines, size_t count);
 void editorDelRow(TextBuffer *buf, int at);
+void editorFreeRows(TextBuffer *buf);
+
+void editorSetStore(TextBuffer *buf, char *store, size_t size, bool mapped);
+void editorRebaseRows(TextBuffer *buf, char *store, size_t size, bool mapped);
 void editorRowInsertChar(TextBuffer *buf, int row_idx, int at, int c);
 char editorRowGetChar(Row *row, int at);
 void editorRowAppendString(TextBuffer *buf, int row_idx, char *s, size_t len);
+void editorInsertText(TextBuffer *buf, int row_idx, int at, const char *s,
+                      size_t len, int *end_row, int *end_col);
 void editorRowDelChar(TextBuffer *buf, int row_idx, int at);
 void editorRowDelChunk(TextBuffer *buf, int row_idx, int from, int to);
 
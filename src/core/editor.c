@@ -14,7 +14,6 @@
 
 #include <stdlib.h>
 #include <unistd.h>
-#include <signal.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -31,6 +30,7 @@ void initEditor(char *file_path)
     E.too_small = false;
     E.rawmode = false;
     E.last_search = NULL;
+    E.search_regex = false;
     E.color_mode = getColorMode();
 
     E.linenums = true;
@@ -42,8 +42,9 @@ void initEditor(char *file_path)
     E.scroll_margin = 5;
     E.horizontal_margin = 0;
 
+    E.batch_latency = 50;
+
     updateWindowSize();
-    signal(SIGWINCH, handleSigWinCh);
 
     if (enableRawMode(STDIN_FILENO) == -1)
     {
@@ -60,6 +61,8 @@ void initEditor(char *file_path)
     initLayout();
 
     E.fb = fbCreate(E.screenrows, E.screencols);
+
+    initSigWinCh();
 }
 
 void editorInsertChar(Window *W, int c)
@@ -67,7 +70,7 @@ void editorInsertChar(Window *W, int c)
     int filerow = W->viewport.rowoff + W->cy;
     int filecol = W->viewport.coloff + W->cx;
     TextBuffer *buf = W->buf;
-    Row *row = (filerow >= buf->numrows) ? NULL : &buf->rows[filerow];
+    Row *row = editorGetRow(buf, filerow);
 
     // TODO: meh
     if (!row)
@@ -83,12 +86,26 @@ void editorInsertChar(Window *W, int c)
     buf->dirty = true;
 }
 
+/* Insert pasted text as it is, without auto indentation or parentheses */
+void editorPaste(Window *W, const char *s, size_t len)
+{
+    int filerow = W->viewport.rowoff + W->cy;
+    int filecol = W->viewport.coloff + W->cx;
+    int end_row, end_col;
+
+    if (len == 0) return;
+
+    editorInsertText(W->buf, filerow, filecol, s, len, &end_row, &end_col);
+
+    editorMoveCursorToPosition(W, end_col, end_row);
+}
+
 char editorGetCharAtCursor(Window *W)
 {
     int filerow = W->viewport.rowoff + W->cy;
     int filecol = W->viewport.coloff + W->cx;
 
-    Row *row = (filerow >= W->buf->numrows) ? NULL : &W->buf->rows[filerow];
+    Row *row = editorGetRow(W->buf, filerow);
     if (!row) return '\0';
 
     return editorRowGetChar(row, filecol);
@@ -101,7 +118,7 @@ char editorGetCharBeforeCursor(Window *W)
 
     if (filecol == 0) return '\0';
 
-    Row *row = (filerow >= W->buf->numrows) ? NULL : &W->buf->rows[filerow];
+    Row *row = editorGetRow(W->buf, filerow);
     if (!row) return '\0';
 
     return editorRowGetChar(row, filecol-1);
@@ -126,13 +143,13 @@ void editorIndentLine(Window *W)
 static void editorIndentNewline(Window *W)
 {
     int filerow = W->viewport.rowoff + W->cy;
-    Row *previous_row = (filerow > 0) ? &W->buf->rows[filerow-1] : NULL;
+    Row *previous_row = editorGetRow(W->buf, filerow-1);
 
     if (previous_row == NULL) return; /* Function misused */
 
-    for (char *current = previous_row->chars; isspace(*current); current++)
+    for (int i = 0; i < previous_row->size && isspace(previous_row->chars[i]); i++)
     {
-        editorInsertChar(W, *current);
+        editorInsertChar(W, previous_row->chars[i]);
     }
 }
 
@@ -141,7 +158,7 @@ void editorInsertNewline(Window *W)
     int filerow = W->viewport.rowoff + W->cy;
     int filecol = W->viewport.coloff + W->cx;
     TextBuffer *buf = W->buf;
-    Row *row = (filerow >= buf->numrows) ? NULL : &buf->rows[filerow];
+    Row *row = editorGetRow(buf, filerow);
 
     if (filecol == 0)
     {
@@ -151,10 +168,7 @@ void editorInsertNewline(Window *W)
     {
         /* We are in the middle of a line. Split it between two rows. */
         editorInsertRow(buf, filerow + 1, row->chars + filecol, row->size - filecol);
-        row = &buf->rows[filerow];
-        row->chars[filecol] = '\0';
-        row->size = filecol;
-        editorUpdateRow(buf, filerow);
+        editorRowDelChunk(buf, filerow, filecol, row->size);
     }
 
     editorMoveCursorLineStart(W);
@@ -167,7 +181,7 @@ void editorDelLine(Window *W)
 {
     int filerow = W->viewport.rowoff + W->cy;
     TextBuffer *buf = W->buf;
-    Row *row = (filerow >= buf->numrows) ? NULL : &buf->rows[filerow];
+    Row *row = editorGetRow(buf, filerow);
 
     if (!row)
         return;
@@ -185,7 +199,7 @@ void editorDelChar(Window *W)
     int filerow = W->viewport.rowoff + W->cy;
     int filecol = W->viewport.coloff + W->cx;
     TextBuffer *buf = W->buf;
-    Row *row = (filerow >= buf->numrows) ? NULL : &buf->rows[filerow];
+    Row *row = editorGetRow(buf, filerow);
 
     if (!row || (filecol == 0 && filerow == 0))
         return;
@@ -194,7 +208,7 @@ void editorDelChar(Window *W)
     {
         /* Handle the case of column 0, we need to move the current line
          * on the right of the previous one. */
-        filecol = buf->rows[filerow - 1].size;
+        filecol = editorRowPrev(row)->size;
         editorRowAppendString(buf, filerow - 1, row->chars, row->size);
         editorDelRow(buf, filerow);
 
@@ -232,7 +246,7 @@ void editorDelChar(Window *W)
             editorMoveCursorLeft(W);
         }
 
-        editorUpdateRow(buf, filerow);
+        editorUpdateRow(buf, row);
     }
     
     buf->dirty = true;
@@ -243,7 +257,7 @@ void editorDelNextChar(Window *W)
     int filerow = W->viewport.rowoff + W->cy;
     int filecol = W->viewport.coloff + W->cx;
     TextBuffer *buf = W->buf;
-    Row *row = (filerow >= buf->numrows) ? NULL : &buf->rows[filerow];
+    Row *row = editorGetRow(buf, filerow);
 
     if (!row) return;
 
@@ -254,7 +268,7 @@ void editorDelNextChar(Window *W)
             
         /* Handle the case of last column, we need to move the next line
          * on the right of the current one. */
-        Row *nextRow = &buf->rows[filerow+1];
+        Row *nextRow = editorRowNext(row);
         editorRowAppendString(buf, filerow, nextRow->chars, nextRow->size);
         editorDelRow(buf, filerow+1);
     }
@@ -271,7 +285,7 @@ void editorDelLineTo(Window *W)
     int filerow = W->viewport.rowoff + W->cy;
     int filecol = W->viewport.coloff + W->cx;
     TextBuffer *buf = W->buf;
-    Row *row = (filerow >= buf->numrows) ? NULL : &buf->rows[filerow];
+    Row *row = editorGetRow(buf, filerow);
 
     if (!row || (filecol == 0 && filerow == 0))
         return;
@@ -286,7 +300,7 @@ void editorDelLineFrom(Window *W)
     int filerow = W->viewport.rowoff + W->cy;
     int filecol = W->viewport.coloff + W->cx;
     TextBuffer *buf = W->buf;
-    Row *row = (filerow >= buf->numrows) ? NULL : &buf->rows[filerow];
+    Row *row = editorGetRow(buf, filerow);
 
     if (!row || (filecol == 0 && filerow == 0))
         return;
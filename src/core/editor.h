@@ -12,6 +12,7 @@
 
 #define EDITOR_QUERY_LEN 128
 #define EDITOR_STATUSMSG_LENGTH 256
+#define EDITOR_STATUSMSG_TIMEOUT 5000 /* ms */
 
 #define EDITOR_MIN_WIDTH 40
 #define EDITOR_MIN_HEIGHT 6
@@ -56,10 +57,13 @@ struct editorConfig
     int scroll_margin;
     int horizontal_margin;
 
+    int batch_latency; /* Max ms spent on queued keys before redrawing */
+
     char statusmsg[EDITOR_STATUSMSG_LENGTH];
     int mode;
 
     char *last_search;
+    bool search_regex; /* The find prompt searches for regular expressions */
 };
 
 extern struct editorConfig E;
@@ -73,6 +77,7 @@ void editorDelLineFrom(Window *W);
 void editorDelChar(Window *W);
 void editorDelNextChar(Window *W);
 void editorInsertChar(Window *W, int c);
+void editorPaste(Window *W, const char *s, size_t len);
 void editorIndentLine(Window *W);
 
 char editorGetCharAtCursor(Window *W);
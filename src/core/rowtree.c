@@ -0,0 +1,243 @@
+#include "rowtree.h"
+
+#include "core.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+static uint32_t rng_state = 2463534242u;
+
+/* xorshift32, we don't need anything better than this for balancing */
+static uint32_t rowTreeRand(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static inline int count(Row *t)
+{
+    return t ? t->count : 0;
+}
+
+static void pull(Row *t)
+{
+    t->count = 1 + count(t->left) + count(t->right);
+
+    if (t->left) t->left->parent = t;
+    if (t->right) t->right->parent = t;
+}
+
+static Row *merge(Row *a, Row *b)
+{
+    if (!a) return b;
+    if (!b) return a;
+
+    /* Keep the tree random: the root of the result is picked
+     * with a probability proportional to the subtree sizes. */
+    if (rowTreeRand() % (uint32_t)(a->count + b->count) < (uint32_t)a->count)
+    {
+        a->right = merge(a->right, b);
+        pull(a);
+        return a;
+    }
+
+    b->left = merge(a, b->left);
+    pull(b);
+    return b;
+}
+
+/* Split t in the first k rows (*l) and the remaining ones (*r). */
+static void split(Row *t, int k, Row **l, Row **r)
+{
+    if (!t)
+    {
+        *l = *r = NULL;
+        return;
+    }
+
+    if (count(t->left) >= k)
+    {
+        split(t->left, k, l, &t->left);
+        pull(t);
+        *r = t;
+    }
+    else
+    {
+        split(t->right, k - count(t->left) - 1, &t->right, r);
+        pull(t);
+        *l = t;
+    }
+}
+
+static Row *insertAt(Row *t, int k, Row *x)
+{
+    /* The new row becomes the root of this subtree with probability 1/(n+1) */
+    if (!t || rowTreeRand() % (uint32_t)(t->count + 1) == 0)
+    {
+        split(t, k, &x->left, &x->right);
+        pull(x);
+        return x;
+    }
+
+    if (k <= count(t->left))
+        t->left = insertAt(t->left, k, x);
+    else
+        t->right = insertAt(t->right, k - count(t->left) - 1, x);
+
+    pull(t);
+    return t;
+}
+
+Row *rowTreeAt(Row *root, int idx)
+{
+    Row *t = root;
+
+    if (idx < 0 || idx >= count(root))
+        return NULL;
+
+    while (t)
+    {
+        int lcount = count(t->left);
+
+        if (idx < lcount)
+        {
+            t = t->left;
+        }
+        else if (idx == lcount)
+        {
+            return t;
+        }
+        else
+        {
+            idx -= lcount + 1;
+            t = t->right;
+        }
+    }
+
+    return NULL;
+}
+
+/* Line numbers are not stored in the rows, otherwise every insertion or
+ * removal would have to renumber all the following lines. We derive them
+ * on demand by walking up to the root and summing the subtree sizes of
+ * everything that comes before the row. */
+int rowTreeIndex(Row *row)
+{
+    int idx = count(row->left);
+
+    for (; row->parent; row = row->parent)
+    {
+        if (row->parent->right == row)
+            idx += count(row->parent->left) + 1;
+    }
+
+    return idx;
+}
+
+void rowTreeInsert(Row **root, int at, Row *row)
+{
+    row->left = NULL;
+    row->right = NULL;
+    row->parent = NULL;
+    row->count = 1;
+
+    *root = insertAt(*root, at, row);
+    (*root)->parent = NULL;
+}
+
+void rowTreeRemove(Row **root, Row *row)
+{
+    Row *m = merge(row->left, row->right);
+    Row *p = row->parent;
+
+    if (m) m->parent = p;
+
+    if (p == NULL)
+    {
+        *root = m;
+    }
+    else
+    {
+        if (p->left == row)
+            p->left = m;
+        else
+            p->right = m;
+
+        for (; p; p = p->parent)
+            p->count--;
+    }
+
+    row->left = NULL;
+    row->right = NULL;
+    row->parent = NULL;
+    row->count = 1;
+}
+
+/* Build a perfectly balanced tree out of n contiguous rows in O(n) */
+Row *rowTreeBuild(Row *rows, int n)
+{
+    if (n <= 0)
+        return NULL;
+
+    int mid = n / 2;
+    Row *t = &rows[mid];
+
+    t->left = rowTreeBuild(rows, mid);
+    t->right = rowTreeBuild(rows + mid + 1, n - mid - 1);
+    t->parent = NULL;
+    pull(t);
+
+    return t;
+}
+
+/* Append all the rows of tree after the ones of *root */
+void rowTreeJoin(Row **root, Row *tree)
+{
+    *root = merge(*root, tree);
+    if (*root)
+        (*root)->parent = NULL;
+}
+
+Row *rowTreeFirst(Row *root)
+{
+    if (!root) return NULL;
+
+    while (root->left)
+        root = root->left;
+
+    return root;
+}
+
+Row *rowTreeLast(Row *root)
+{
+    if (!root) return NULL;
+
+    while (root->right)
+        root = root->right;
+
+    return root;
+}
+
+Row *rowTreeNext(Row *row)
+{
+    if (row->right)
+        return rowTreeFirst(row->right);
+
+    while (row->parent && row->parent->right == row)
+        row = row->parent;
+
+    return row->parent;
+}
+
+Row *rowTreePrev(Row *row)
+{
+    if (row->left)
+        return rowTreeLast(row->left);
+
+    while (row->parent && row->parent->left == row)
+        row = row->parent;
+
+    return row->parent;
+}
@@ -0,0 +1,23 @@
+#ifndef __EDITOR_ROWTREE_H
+#define __EDITOR_ROWTREE_H
+
+typedef struct Row Row;
+
+/* The rows of a text buffer are kept in a randomized binary search tree
+ * ordered by line position, where every node knows the size of its
+ * subtree. This gives O(log n) access, insertion and removal of lines
+ * regardless of the size of the file, while Row pointers stay stable. */
+
+Row *rowTreeAt(Row *root, int idx);
+int rowTreeIndex(Row *row);
+void rowTreeInsert(Row **root, int at, Row *row);
+void rowTreeRemove(Row **root, Row *row);
+Row *rowTreeBuild(Row *rows, int n);
+void rowTreeJoin(Row **root, Row *tree);
+
+Row *rowTreeFirst(Row *root);
+Row *rowTreeLast(Row *root);
+Row *rowTreeNext(Row *row);
+Row *rowTreePrev(Row *row);
+
+#endif /* __EDITOR_ROWTREE_H */
@@ -4,6 +4,7 @@
 #include "core.h"
 #include "event.h"
 #include "utils.h"
+#include "commands.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -28,8 +29,15 @@ TextBuffer *createBuffer(const char *file_path)
         exit(EXIT_FAILURE);
     }
     buf->numrows = 0;
-    buf->rows = NULL;
+    buf->root = NULL;
+    buf->store = NULL;
+    buf->store_size = 0;
+    buf->store_mapped = false;
+    vector_init(&buf->slabs, Row *);
+    buf->free_rows = NULL;
+    buf->loader = NULL;
     buf->syntax = NULL;
+    buf->hl_frontier = 0;
     buf->file_path = strdup(file_path);
     buf->filename = get_filename_from_path(buf->file_path);
     buf->dirty = false;
@@ -76,13 +84,8 @@ void deleteBuffer(TextBuffer *buf)
 
     free(buf->file_path);
 
-    for (int i = 0; i < buf->numrows; i++)
-    {
-        free(buf->rows[i].chars);
-        freeRender(&buf->rows[i].render);
-    }
-
-    free(buf->rows);
+    editorStopLoading(buf);
+    editorFreeRows(buf);
 
     free(buf);
 
@@ -2,6 +2,9 @@
 #define __EDITOR_TEXTBUFFER_H
 
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "vector.h"
 
 #define INDENT_WITH_TABS 0
 #define INDENT_WITH_SPACES 1
@@ -10,14 +13,22 @@
 
 typedef struct Row Row;
 typedef struct Syntax Syntax;
+typedef struct FileLoader FileLoader;
 
 typedef struct TextBuffer
 {
     char *file_path;
     const char *filename;
     int numrows;
-    Row *rows;
+    Row *root;         /* Root of the line tree */
+    char *store;       /* Text shared by the rows loaded from disk */
+    size_t store_size;
+    bool store_mapped; /* The store is a mmap()ed file */
+    Vector slabs;      /* Blocks of rows allocated at once by the loader */
+    Row *free_rows;    /* Unused rows of the slabs */
+    FileLoader *loader; /* Not NULL while the store is being split in rows */
     Syntax *syntax;
+    int hl_frontier;   /* The rows above are highlighted and up to date */
     bool dirty;
     bool indent_mode;
     unsigned char indent_size;
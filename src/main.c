@@ -1,6 +1,7 @@
 #include "ui.h"
 #include "editor.h"
 #include "event.h"
+#include "loop.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -22,10 +23,11 @@ int main(int argc, char **argv)
     while (1)
     {
         if (!E.too_small)
-        {
             editorRefreshScreen();
-            editorProcessKeypress(STDIN_FILENO);
-        }
+
+        /* Sleep until a key, a background job or a timer needs us */
+        if (editorWaitEvents(STDIN_FILENO))
+            editorProcessInput(STDIN_FILENO);
     }
 
     return 0;
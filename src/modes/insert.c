@@ -96,6 +96,13 @@ void editorIMProcessKeypress(int key)
     case TAB:
         editorIndentLine(E.active_win);
         break;
+    case PASTE:
+    {
+        size_t len;
+        const char *text = editorGetPaste(&len);
+        editorPaste(E.active_win, text, len);
+        break;
+    }
     case ESC:
         editorSetNormalMode();
         break;
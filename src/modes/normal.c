@@ -170,6 +170,13 @@ void editorNMProcessKeypress(int key)
     case '$':
         editorMoveCursorLineEnd(E.active_win);
         break;
+    case PASTE:
+    {
+        size_t len;
+        const char *text = editorGetPaste(&len);
+        editorPaste(E.active_win, text, len);
+        break;
+    }
     case ':':
         editorShell(STDIN_FILENO);
         break;
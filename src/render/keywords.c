@@ -0,0 +1,175 @@
+#include "keywords.h"
+
+#include "utils.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Keywords ending at the same node (the same word in more groups) are
+ * chained in the order they were added, which is their priority. */
+typedef struct KeywordEntry
+{
+    int next;
+    unsigned char color;
+    bool call;   /* Only if followed by '(' */
+} KeywordEntry;
+
+typedef struct KeywordEdge
+{
+    uint32_t key;   /* node << 8 | byte */
+    uint32_t child; /* 0 if the slot is empty, the root is never a child */
+} KeywordEdge;
+
+struct KeywordTrie
+{
+    KeywordEdge *edges;
+    size_t mask;
+    int *terminal;  /* First entry of each node, -1 if no keyword ends there */
+    size_t num_nodes, max_nodes;
+    KeywordEntry *entries;
+    size_t num_entries, max_entries;
+};
+
+static size_t edgeHash(uint32_t key, size_t mask)
+{
+    return (key * 2654435761u) & mask;
+}
+
+static uint32_t trieChild(const KeywordTrie *trie, uint32_t node, unsigned char c)
+{
+    uint32_t key = node << 8 | c;
+    size_t i = edgeHash(key, trie->mask);
+
+    while (trie->edges[i].child != 0)
+    {
+        if (trie->edges[i].key == key)
+            return trie->edges[i].child;
+        i = (i + 1) & trie->mask;
+    }
+
+    return 0;
+}
+
+/* Room for the given number of keywords, made of bytes characters overall */
+KeywordTrie *keywordTrieCreate(size_t keywords, size_t bytes)
+{
+    KeywordTrie *trie = calloc(1, sizeof(KeywordTrie));
+    if (trie == NULL)
+        return NULL;
+
+    trie->max_nodes = bytes + 1;
+    trie->max_entries = keywords;
+
+    /* Keep the table at most half full */
+    size_t slots = 16;
+    while (slots < 2 * trie->max_nodes)
+        slots <<= 1;
+    trie->mask = slots - 1;
+
+    trie->edges = calloc(slots, sizeof(KeywordEdge));
+    trie->terminal = malloc(trie->max_nodes * sizeof(int));
+    trie->entries = malloc((keywords ? keywords : 1) * sizeof(KeywordEntry));
+    if (!trie->edges || !trie->terminal || !trie->entries)
+    {
+        keywordTrieFree(trie);
+        return NULL;
+    }
+
+    trie->terminal[0] = -1;
+    trie->num_nodes = 1;
+
+    return trie;
+}
+
+void keywordTrieFree(KeywordTrie *trie)
+{
+    if (trie == NULL)
+        return;
+
+    free(trie->edges);
+    free(trie->terminal);
+    free(trie->entries);
+    free(trie);
+}
+
+int keywordTrieAdd(KeywordTrie *trie, const char *keyword, unsigned char color, bool call)
+{
+    if (trie->num_entries == trie->max_entries)
+        return -1;
+
+    uint32_t node = 0;
+    for (const unsigned char *p = (const unsigned char *)keyword; *p; p++)
+    {
+        uint32_t child = trieChild(trie, node, *p);
+        if (child == 0)
+        {
+            if (trie->num_nodes == trie->max_nodes)
+                return -1;
+
+            child = trie->num_nodes++;
+            trie->terminal[child] = -1;
+
+            uint32_t key = node << 8 | *p;
+            size_t i = edgeHash(key, trie->mask);
+            while (trie->edges[i].child != 0)
+                i = (i + 1) & trie->mask;
+            trie->edges[i] = (KeywordEdge){.key = key, .child = child};
+        }
+        node = child;
+    }
+
+    int entry = trie->num_entries++;
+    trie->entries[entry] = (KeywordEntry){.next = -1, .color = color, .call = call};
+
+    int *last = &trie->terminal[node];
+    while (*last != -1)
+        last = &trie->entries[*last].next;
+    *last = entry;
+
+    return 0;
+}
+
+/* Whether some keyword begins with c */
+bool keywordTrieStartsWith(const KeywordTrie *trie, unsigned char c)
+{
+    return trieChild(trie, 0, c) != 0;
+}
+
+/* Find the keyword at the start of s. Like a scan of the keyword lists in
+ * order, a keyword matches only if it is followed by a separator, and the
+ * first one added wins. Return its length and set *color, 0 if none. */
+int keywordTrieMatch(const KeywordTrie *trie, const char *s, unsigned char *color)
+{
+    uint32_t node = 0;
+    int best = -1;
+    int best_len = 0;
+
+    for (int len = 1; s[len - 1]; len++)
+    {
+        node = trieChild(trie, node, (unsigned char)s[len - 1]);
+        if (node == 0)
+            break;
+
+        if (trie->terminal[node] == -1 || !is_separator(s[len]))
+            continue;
+
+        for (int e = trie->terminal[node]; e != -1; e = trie->entries[e].next)
+        {
+            if (trie->entries[e].call && s[len] != '(')
+                continue;
+
+            if (best == -1 || e < best)
+            {
+                best = e;
+                best_len = len;
+            }
+            break;
+        }
+    }
+
+    if (best == -1)
+        return 0;
+
+    *color = trie->entries[best].color;
+    return best_len;
+}
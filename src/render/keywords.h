@@ -0,0 +1,19 @@
+#ifndef __EDITOR_KEYWORDS_H
+#define __EDITOR_KEYWORDS_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* The keywords of a syntax are kept in a trie whose edges are stored in a
+ * single hash table keyed by (node, byte). Classifying a token costs one
+ * probe per byte, whatever the number of keywords. */
+
+typedef struct KeywordTrie KeywordTrie;
+
+KeywordTrie *keywordTrieCreate(size_t keywords, size_t bytes);
+void keywordTrieFree(KeywordTrie *trie);
+int keywordTrieAdd(KeywordTrie *trie, const char *keyword, unsigned char color, bool call);
+bool keywordTrieStartsWith(const KeywordTrie *trie, unsigned char c);
+int keywordTrieMatch(const KeywordTrie *trie, const char *s, unsigned char *color);
+
+#endif /* __EDITOR_KEYWORDS_H */
@@ -0,0 +1,337 @@
+#include "lexer.h"
+
+#include "syntax.h"
+#include "keywords.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/* The comment states come last, see lexerRun() */
+enum LexState
+{
+    LEX_CODE = 0,    /* After a separator, or at the start of the row */
+    LEX_WORD,        /* After anything else */
+    LEX_NUMBER,      /* After a digit of a number */
+    LEX_OPEN_LINE,   /* After the first byte of the single line comment */
+    LEX_OPEN_BLOCK,  /* After the first byte of the multi line comment */
+    LEX_OPEN_BOTH,   /* The same, when the two comments share it */
+    LEX_DQUOTE,
+    LEX_DQUOTE_ESC,
+    LEX_SQUOTE,
+    LEX_SQUOTE_ESC,
+    LEX_INDENT,      /* Leading spaces of a row inside a comment */
+    LEX_COMMENT,
+    LEX_CLOSE,       /* After the first byte of the comment end */
+    LEX_STATES
+};
+
+enum LexFlags
+{
+    LEX_KEEP = (1 << 0),     /* Leave the highlight set by the render */
+    LEX_PREV = (1 << 1),     /* Paint the previous byte too */
+    LEX_LINE = (1 << 2),     /* Paint up to the end of the row */
+    LEX_KEYWORD = (1 << 3),  /* Try a keyword first */
+    LEX_LOSSY = (1 << 4)     /* Paints over a byte marked by the render */
+};
+
+typedef struct LexTransition
+{
+    unsigned char next;
+    unsigned char color;
+    unsigned char flags;
+} LexTransition;
+
+/* Bytes the render has marked (tabs, invalid characters) are looked up
+ * with LEX_SKIPPED set, since most states leave them alone. */
+#define LEX_SKIPPED 0x100
+#define LEX_SYMBOLS 0x200
+
+struct Lexer
+{
+    unsigned short classes[LEX_SYMBOLS];
+    size_t num_classes;
+    LexTransition *table;  /* [state * num_classes + class] */
+};
+
+/* The rules below are only run to fill the table */
+
+static LexTransition trans(int next, int color, int flags)
+{
+    return (LexTransition){.next = next, .color = color, .flags = flags};
+}
+
+static size_t delimiterLen(const char *delim, size_t max)
+{
+    return strnlen(delim, max);
+}
+
+/* Code outside of strings and comments. A byte that starts a comment
+ * delimiter is a plain character if the delimiter doesn't follow. */
+static LexTransition codeStep(const Syntax *syntax, int state, int sym)
+{
+    unsigned char c = sym & 0xff;
+    size_t line = delimiterLen(syntax->singleline_comment_start, 2);
+    size_t block = delimiterLen(syntax->multiline_comment_start, 2);
+    bool sep = (state == LEX_CODE);
+
+    if (sym & LEX_SKIPPED)
+        return trans(LEX_CODE, HL_NORMAL, LEX_KEEP);
+
+    bool open_block = block > 0 && c == (unsigned char)syntax->multiline_comment_start[0];
+    bool open_line = line > 0 && sep && c == (unsigned char)syntax->singleline_comment_start[0];
+
+    if (open_block)
+    {
+        if (block == 1)
+            return trans(LEX_COMMENT, HL_MLCOMMENT, 0);
+
+        return trans(open_line && line == 2 ? LEX_OPEN_BOTH : LEX_OPEN_BLOCK, HL_NORMAL, 0);
+    }
+
+    if (open_line)
+    {
+        if (line == 1)
+            return trans(LEX_CODE, HL_COMMENT, LEX_LINE);
+
+        return trans(LEX_OPEN_LINE, HL_NORMAL, 0);
+    }
+
+    if (syntax->flags & HL_HIGHLIGHT_STRINGS)
+    {
+        if (c == '"')
+            return trans(LEX_DQUOTE, HL_STRING, 0);
+        if (c == '\'')
+            return trans(LEX_SQUOTE, HL_STRING, 0);
+    }
+
+    if (syntax->flags & HL_HIGHLIGHT_NUMBERS)
+    {
+        if (isdigit(c) && (sep || state == LEX_NUMBER))
+            return trans(LEX_NUMBER, HL_NUMBER, 0);
+        if (c == '.' && state == LEX_NUMBER)
+            return trans(LEX_NUMBER, HL_NUMBER, 0);
+    }
+
+    int flags = 0;
+    if (sep && syntax->keywords && keywordTrieStartsWith(syntax->keywords, c))
+        flags = LEX_KEYWORD;
+
+    return trans(is_separator(c) ? LEX_CODE : LEX_WORD, HL_NORMAL, flags);
+}
+
+static LexTransition stringStep(int state, int sym)
+{
+    bool dquote = (state == LEX_DQUOTE || state == LEX_DQUOTE_ESC);
+    int string = dquote ? LEX_DQUOTE : LEX_SQUOTE;
+    unsigned char c = sym & 0xff;
+
+    /* Escapes take the next byte, whatever it is */
+    if (state == LEX_DQUOTE_ESC || state == LEX_SQUOTE_ESC)
+        return trans(string, HL_STRING, (sym & LEX_SKIPPED) ? LEX_LOSSY : 0);
+
+    if (sym & LEX_SKIPPED)
+        return trans(state, HL_NORMAL, LEX_KEEP);
+    if (c == '\\')
+        return trans(dquote ? LEX_DQUOTE_ESC : LEX_SQUOTE_ESC, HL_STRING, 0);
+    if (c == (dquote ? '"' : '\''))
+        return trans(LEX_WORD, HL_STRING, 0);
+
+    return trans(state, HL_STRING, 0);
+}
+
+static LexTransition commentStep(const Syntax *syntax, int sym)
+{
+    unsigned char c = sym & 0xff;
+    size_t end = delimiterLen(syntax->multiline_comment_end, 2);
+
+    if (sym & LEX_SKIPPED)
+        return trans(LEX_COMMENT, HL_NORMAL, LEX_KEEP);
+
+    if (end > 0 && c == (unsigned char)syntax->multiline_comment_end[0])
+        return trans(end == 1 ? LEX_CODE : LEX_CLOSE, HL_MLCOMMENT, 0);
+
+    return trans(LEX_COMMENT, HL_MLCOMMENT, 0);
+}
+
+static LexTransition step(const Syntax *syntax, int state, int sym)
+{
+    unsigned char c = sym & 0xff;
+    const char *line = syntax->singleline_comment_start;
+    const char *block = syntax->multiline_comment_start;
+
+    switch (state)
+    {
+    case LEX_CODE:
+    case LEX_WORD:
+    case LEX_NUMBER:
+        return codeStep(syntax, state, sym);
+
+    case LEX_OPEN_LINE:
+    case LEX_OPEN_BLOCK:
+    case LEX_OPEN_BOTH:
+    {
+        bool skipped = sym & LEX_SKIPPED;
+
+        if (state != LEX_OPEN_LINE && !skipped && c == (unsigned char)block[1])
+            return trans(LEX_COMMENT, HL_MLCOMMENT, LEX_PREV);
+        if (state != LEX_OPEN_BLOCK && !skipped && c == (unsigned char)line[1])
+            return trans(LEX_CODE, HL_COMMENT, LEX_PREV | LEX_LINE);
+
+        /* Not a comment, go on from after the first byte */
+        unsigned char first = (state == LEX_OPEN_LINE) ? line[0] : block[0];
+        return codeStep(syntax, is_separator(first) ? LEX_CODE : LEX_WORD, sym);
+    }
+
+    case LEX_DQUOTE:
+    case LEX_DQUOTE_ESC:
+    case LEX_SQUOTE:
+    case LEX_SQUOTE_ESC:
+        return stringStep(state, sym);
+
+    case LEX_INDENT:
+        if (isspace(c))
+            return trans(LEX_INDENT, HL_NORMAL, (sym & LEX_SKIPPED) ? LEX_KEEP : 0);
+        return commentStep(syntax, sym);
+
+    case LEX_CLOSE:
+        if (!(sym & LEX_SKIPPED) && c == (unsigned char)syntax->multiline_comment_end[1])
+            return trans(LEX_CODE, HL_MLCOMMENT, 0);
+        return commentStep(syntax, sym);
+
+    case LEX_COMMENT:
+    default:
+        return commentStep(syntax, sym);
+    }
+}
+
+/* Build the transition table of a syntax. Symbols whose transitions are
+ * the same in every state share a class, so the table stays small. */
+Lexer *lexerCreate(const Syntax *syntax)
+{
+    Lexer *lexer = calloc(1, sizeof(Lexer));
+    if (lexer == NULL)
+        return NULL;
+
+    LexTransition (*columns)[LEX_STATES] = malloc(LEX_SYMBOLS * sizeof(*columns));
+    if (columns == NULL)
+    {
+        free(lexer);
+        return NULL;
+    }
+
+    for (int sym = 0; sym < LEX_SYMBOLS; sym++)
+    {
+        LexTransition column[LEX_STATES];
+        for (int state = 0; state < LEX_STATES; state++)
+        {
+            column[state] = step(syntax, state, sym);
+        }
+
+        size_t class = 0;
+        while (class < lexer->num_classes && memcmp(columns[class], column, sizeof(column)) != 0)
+            class++;
+
+        if (class == lexer->num_classes)
+        {
+            memcpy(columns[class], column, sizeof(column));
+            lexer->num_classes++;
+        }
+
+        lexer->classes[sym] = class;
+    }
+
+    lexer->table = malloc(LEX_STATES * lexer->num_classes * sizeof(LexTransition));
+    if (lexer->table == NULL)
+    {
+        free(columns);
+        free(lexer);
+        return NULL;
+    }
+
+    for (int state = 0; state < LEX_STATES; state++)
+    {
+        for (size_t class = 0; class < lexer->num_classes; class++)
+        {
+            lexer->table[state * lexer->num_classes + class] = columns[class][state];
+        }
+    }
+
+    free(columns);
+    return lexer;
+}
+
+void lexerFree(Lexer *lexer)
+{
+    if (lexer == NULL)
+        return;
+
+    free(lexer->table);
+    free(lexer);
+}
+
+/* Highlight a rendered row starting from the state left by the previous
+ * one, and return the state at its end. The marks of the render (tabs and
+ * invalid characters) are kept, except inside single line comments and
+ * escapes; *lossy tells if some were lost, and the row has to be rendered
+ * again before it is highlighted from a different state. */
+unsigned char lexerRun(const Lexer *lexer, const Syntax *syntax, RenderRow *render, unsigned char state, bool *lossy)
+{
+    const unsigned char *c = (const unsigned char *)render->c;
+    unsigned char *hl = render->hl;
+    size_t n = render->size;
+    int s = (state == HL_STATE_COMMENT) ? LEX_INDENT : LEX_CODE;
+    *lossy = false;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        int sym = c[i];
+        if (hl[i] == HL_TAB || hl[i] == HL_NONPRINT)
+            sym |= LEX_SKIPPED;
+
+        const LexTransition *t = &lexer->table[s * lexer->num_classes + lexer->classes[sym]];
+        s = t->next;
+
+        if (t->flags == 0)
+        {
+            hl[i] = t->color;
+            continue;
+        }
+
+        if (t->flags & LEX_KEYWORD)
+        {
+            unsigned char color;
+            int len = keywordTrieMatch(syntax->keywords, render->c + i, &color);
+            if (len > 0)
+            {
+                memset(hl + i, color, len);
+                i += len - 1;
+                s = LEX_WORD;
+                continue;
+            }
+        }
+
+        if (t->flags & LEX_KEEP)
+            continue;
+
+        if (t->flags & LEX_PREV)
+            hl[i - 1] = t->color;
+
+        if (t->flags & LEX_LOSSY)
+            *lossy = true;
+
+        if (t->flags & LEX_LINE)
+        {
+            if (memchr(hl + i, HL_TAB, n - i) || memchr(hl + i, HL_NONPRINT, n - i))
+                *lossy = true;
+
+            memset(hl + i, t->color, n - i);
+            break;
+        }
+
+        hl[i] = t->color;
+    }
+
+    return s >= LEX_INDENT ? HL_STATE_COMMENT : HL_STATE_NORMAL;
+}
@@ -0,0 +1,20 @@
+#ifndef __EDITOR_LEXER_H
+#define __EDITOR_LEXER_H
+
+#include "render.h"
+
+#include <stdbool.h>
+
+/* The rules of a syntax (comment delimiters, strings, numbers and where
+ * keywords may start) are compiled into a DFA over byte classes. Rows are
+ * highlighted with one table lookup per byte; keywords are classified
+ * through the keyword trie when the DFA reaches the start of one. */
+
+typedef struct Syntax Syntax;
+typedef struct Lexer Lexer;
+
+Lexer *lexerCreate(const Syntax *syntax);
+void lexerFree(Lexer *lexer);
+unsigned char lexerRun(const Lexer *lexer, const Syntax *syntax, RenderRow *render, unsigned char state, bool *lossy);
+
+#endif /* __EDITOR_LEXER_H */
@@ -12,9 +12,32 @@
 #include <ctype.h>
 #include <string.h>
 
-static void updateRenderedRow(TextBuffer *buf, int row_idx)
+/* Generations are taken from a single counter, so a row allocated where
+ * a deleted one was can't be mistaken for it */
+static unsigned int render_generation = 0;
+
+/* Must be called whenever the render or the highlight of a row changes,
+ * windows compose again only the rows whose generation moved. */
+void editorRowChanged(Row *row)
+{
+    row->gen = ++render_generation;
+}
+
+/* Other threads can't touch the counter: the main thread takes count
+ * generations at once, and they number the rows they change from the
+ * returned one */
+unsigned int editorReserveGenerations(unsigned int count)
+{
+    unsigned int first = render_generation + 1;
+    render_generation += count;
+
+    return first;
+}
+
+static void renderRow(TextBuffer *buf, Row *row)
 {
-    Row *row = &buf->rows[row_idx];
+    row->flags &= ~ROW_HL_LOSSY;
+
     unsigned int tabs = 0;
 
     for (int j = 0; j < row->size; j++)
@@ -96,18 +119,40 @@ static void updateRenderedRow(TextBuffer *buf, int row_idx)
     render->c[idx] = '\0';
 }
 
-void editorUpdateRow(TextBuffer *buf, int row_idx)
+static void updateRenderedRow(TextBuffer *buf, Row *row)
+{
+    editorRowChanged(row);
+    renderRow(buf, row);
+}
+
+void editorUpdateRow(TextBuffer *buf, Row *row)
+{
+    updateRenderedRow(buf, row);
+    editorUpdateSyntax(buf, row);
+}
+
+/* Rows are rendered the first time they are needed, not when created */
+void editorRenderRow(TextBuffer *buf, Row *row)
+{
+    if (row->render.c == NULL)
+        updateRenderedRow(buf, row);
+}
+
+/* Render a row again without changing its generation, so that more
+ * threads can render the rows of a buffer, each its own ones */
+void editorRenderRowConcurrent(TextBuffer *buf, Row *row)
 {
-    updateRenderedRow(buf, row_idx);
-    editorUpdateSyntax(buf, row_idx);
+    renderRow(buf, row);
 }
 
 void editorUpdateRender(TextBuffer *buf)
 {
-    for (int i = 0; i < buf->numrows; i++)
+    for (Row *row = editorGetRow(buf, 0); row; row = editorRowNext(row))
     {
-        updateRenderedRow(buf, i);
-        editorUpdateSyntax(buf, i);
+        /* The others will be rendered with the new settings anyway */
+        if (row->render.c != NULL)
+            updateRenderedRow(buf, row);
+        editorUpdateSyntax(buf, row);
     }
 }
 
@@ -5,6 +5,7 @@
 #include <unistd.h>
 
 typedef struct TextBuffer TextBuffer;
+typedef struct Row Row;
 
 typedef struct RenderRow
 {
@@ -15,7 +16,11 @@ typedef struct RenderRow
 
 #define RENDER_NULL (RenderRow){NULL, NULL, 0}
 
-void editorUpdateRow(TextBuffer *buf, int row_idx);
+void editorUpdateRow(TextBuffer *buf, Row *row);
+void editorRenderRow(TextBuffer *buf, Row *row);
+void editorRenderRowConcurrent(TextBuffer *buf, Row *row);
+void editorRowChanged(Row *row);
+unsigned int editorReserveGenerations(unsigned int count);
 void editorUpdateRender(TextBuffer *buf);
 
 void freeRender(RenderRow *r);
@@ -6,26 +6,13 @@
 #include "utils.h"
 #include "textbuffer.h"
 #include "render.h"
+#include "keywords.h"
+#include "lexer.h"
+#include "syntaxdb.h"
+#include "workpool.h"
 
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
-
-enum HL_Flags{
-    HL_HIGHLIGHT_STRINGS = (1 << 0),
-    HL_HIGHLIGHT_NUMBERS = (1 << 1)
-};
-
-#define GROUP_TYPE_NORMAL 0
-#define GROUP_TYPE_FUNCTION 1
-#define GROUP_TYPE_FORCE 2
-
-typedef struct SyntaxGroup
-{
-    char **keywords;
-    Color color;
-    uint8_t type;
-} SyntaxGroup;
 
 char *c_extensions[] = {".c", ".h", NULL};
 char *c_keywords1[] = {
@@ -195,7 +182,8 @@ Syntax HLDB[] = {
     sizeof(c_group)/sizeof(SyntaxGroup),
     "//", 
     "/*", "*/",
-    HL_HIGHLIGHT_STRINGS | HL_HIGHLIGHT_NUMBERS
+    HL_HIGHLIGHT_STRINGS | HL_HIGHLIGHT_NUMBERS,
+    NULL, NULL
 },
 {
     rust_extensions,
@@ -203,229 +191,195 @@ Syntax HLDB[] = {
     sizeof(rust_group)/sizeof(SyntaxGroup),
     "//", 
     "/*", "*/",
-    HL_HIGHLIGHT_STRINGS | HL_HIGHLIGHT_NUMBERS
+    HL_HIGHLIGHT_STRINGS | HL_HIGHLIGHT_NUMBERS,
+    NULL, NULL
 }
 };
 
-typedef struct HighlightState
-{
-    Row *row;
-    Syntax *syntax;
-    const char *r_current;
-    unsigned char *hl_current;
-    int in_string;
-    bool in_comment;
-    bool prev_sep;
-} HighlightState;
-
-/* Return true if the specified row last char is part of a multi line comment
- * that starts at this row or at one before, and does not end at the end
- * of the row but spawns to the next row. */
-static bool editorRowHasOpenComment(Row *row)
+/* Run the lexer on a row, rendering it first if needed. Doesn't change
+ * the generation, so the worker threads can call it. */
+static unsigned char lexRow(TextBuffer *buf, Row *row, unsigned char state)
 {
-    if (row->render.hl && row->render.size && 
-        row->render.hl[row->render.size - 1] == HL_MLCOMMENT &&
-        (row->render.size < 2 || 
-        row->render.c[row->render.size - 2] != '*' ||
-        row->render.c[row->render.size - 1] != '/'))
-    {
-        return true;
-    }
+    if (row->render.c == NULL || (row->flags & ROW_HL_LOSSY))
+        editorRenderRowConcurrent(buf, row);
 
-    return false;
-}
+    bool lossy;
+    Syntax *syntax = buf->syntax;
+    state = lexerRun(syntax->lexer, syntax, &row->render, state, &lossy);
 
-static bool Highlight_Skip(HighlightState *s)
-{
-    if (*(s->hl_current) != HL_NORMAL)
-    {
-        s->r_current++;
-        s->hl_current++;
-        s->prev_sep = 1;
-        return true;
-    }
-    return false;
+    if (lossy)
+        row->flags |= ROW_HL_LOSSY;
+
+    return state;
 }
 
-static bool Highlight_SingleLineComment(HighlightState *s)
+/* Highlight a row starting from the lexer state left by the previous
+ * one. If the state at its end changes, the next row is marked stale. */
+static void highlightRow(TextBuffer *buf, Row *row, unsigned char state)
 {
-    char *start = s->syntax->singleline_comment_start;
+    editorRowChanged(row);
+
+    state = lexRow(buf, row, state);
+
+    row->flags &= ~ROW_HL_STALE;
 
-    if (s->prev_sep && *s->r_current == start[0] && *(s->r_current + 1) == start[1])
+    if (state != row->hl_state)
     {
-        memset(s->hl_current, HL_COMMENT, s->row->render.size - (s->hl_current-s->row->render.hl));
-        return true;
+        row->hl_state = state;
+
+        Row *next = editorRowNext(row);
+        if (next != NULL)
+            next->flags |= ROW_HL_STALE;
     }
-    return false;
 }
 
-static bool Highlight_MultiLineComment(HighlightState *s)
+/* Called when row has changed or follows a different row. It is only
+ * marked stale: rows are highlighted when they are about to be used. */
+void editorUpdateSyntax(TextBuffer *buf, Row *row)
 {
-    char *start = s->syntax->multiline_comment_start;
-    char *end = s->syntax->multiline_comment_end;
+    if (buf->syntax == NULL)
+        return;
 
-    if (s->in_comment)
-    {
-        *s->hl_current = HL_MLCOMMENT;
-        if (*s->r_current == end[0] && *(s->r_current + 1) == end[1])
-        {
-            *(s->hl_current + 1) = HL_MLCOMMENT;
-            s->r_current += 2;
-            s->hl_current += 2;
-            s->in_comment = 0;
-            s->prev_sep = 1;
-        }
-        else
-        {
-            s->r_current++;
-            s->hl_current++;
-            s->prev_sep = 0;
-        }
-        return true;
-    }
-    else if (*s->r_current == start[0] && *(s->r_current + 1) == start[1])
+    row->flags |= ROW_HL_STALE;
+
+    if (buf->hl_frontier > 0)
     {
-        *(s->hl_current) = HL_MLCOMMENT;
-        *(s->hl_current + 1) = HL_MLCOMMENT;
-        s->r_current += 2;
-        s->hl_current += 2;
-        s->in_comment = 1;
-        s->prev_sep = 0;
-        return true;
+        int idx = editorRowIndex(row);
+        if (idx < buf->hl_frontier)
+            buf->hl_frontier = idx;
     }
-    return false;
 }
 
-static bool Highlight_String(HighlightState *s)
+/* Below this many rows, waking the threads costs more than it saves */
+#define HL_PARALLEL_MIN_ROWS 16384
+
+typedef struct HighlightChunk
+{
+    TextBuffer *buf;
+    Row *first;
+    int count;
+    unsigned char state;  /* Assumed before the first row */
+    unsigned int gen;     /* Generation of the first row */
+} HighlightChunk;
+
+/* Highlight the rows of a chunk like the serial loop does, from a state
+ * that is only a guess except for the first chunk. Rows are only touched
+ * by the thread that owns their chunk. */
+static void highlightChunk(void *arg, size_t task)
 {
-    if (s->in_string)
+    HighlightChunk *chunk = (HighlightChunk *)arg + task;
+    unsigned char state = chunk->state;
+
+    /* A guessed state must be applied to the first row */
+    bool changed = (task != 0);
+
+    Row *r = chunk->first;
+    for (int i = 0; i < chunk->count; i++, r = editorRowNext(r))
     {
-        *(s->hl_current) = HL_STRING;
-        if (*s->r_current == '\\' && *(s->r_current + 1))
+        if (changed || (r->flags & ROW_HL_STALE))
         {
-            *(s->hl_current + 1) = HL_STRING;
-            s->r_current += 2;
-            s->hl_current += 2;
+            state = lexRow(chunk->buf, r, state);
+
+            changed = (state != r->hl_state);
+            r->hl_state = state;
+            r->flags &= ~ROW_HL_STALE;
+            r->gen = chunk->gen + i;
         }
         else
         {
-            if (*s->r_current == s->in_string)
-                s->in_string = 0;
-            s->r_current++;
-            s->hl_current++;
+            changed = false;
+            state = r->hl_state;
         }
-        s->prev_sep = 0;
-        return true;
     }
-    else if (*s->r_current == '"' || *s->r_current == '\'')
-    {
-        s->in_string = *s->r_current;
-        *(s->hl_current) = HL_STRING;
-        s->r_current++;
-        s->hl_current++;
-        s->prev_sep = 0;
-        return true;
-    }
-    return false;
 }
 
-static bool Highlight_Number(HighlightState *s)
+/* Highlight rows from..to splitting them among the worker threads. Each
+ * chunk but the first starts from the normal state; then, in order, the
+ * rows at the start of a chunk are highlighted again from the real state
+ * left by the previous chunk, until it matches the one that was guessed.
+ * The result is the same as the serial loop. */
+static void highlightParallel(TextBuffer *buf, int from, int to, unsigned char state)
 {
-    bool is_number = (isdigit(*s->r_current) && (s->prev_sep || *(s->hl_current - 1) == HL_NUMBER));
-    bool is_float = (*s->r_current == '.' && s->hl_current > s->row->render.hl && *(s->hl_current - 1) == HL_NUMBER);
+    int rows = to - from + 1;
+    int num_chunks = work_pool_threads() + 1;
+    int per_chunk = (rows + num_chunks - 1) / num_chunks;
+
+    HighlightChunk chunks[WORK_POOL_MAX_THREADS + 1];
+    unsigned int gen = editorReserveGenerations(rows);
+
+    Row *last = editorGetRow(buf, to);
+    unsigned char last_state = last->hl_state;
 
-    if (is_number || is_float)
+    for (int c = 0; c < num_chunks; c++)
     {
-        *(s->hl_current) = HL_NUMBER;
-        s->r_current++;
-        s->hl_current++;
-        s->prev_sep = 0;
-        return true;
+        int start = c * per_chunk;
+        chunks[c] = (HighlightChunk){
+            .buf = buf,
+            .first = editorGetRow(buf, from + start),
+            .count = (start + per_chunk <= rows) ? per_chunk : rows - start,
+            .state = (c == 0) ? state : HL_STATE_NORMAL,
+            .gen = gen + start
+        };
     }
-    return false;
-}
 
-static bool Highlight_Keywords(HighlightState *s)
-{
-    if (!s->prev_sep)
-        return false;
+    work_pool_run(highlightChunk, chunks, num_chunks);
 
-    SyntaxGroup *groups = s->syntax->groups;
-    for (size_t i = 0; i < s->syntax->group_num; i++)
+    for (int c = 1; c < num_chunks; c++)
     {
-        char **keywords = groups[i].keywords;
-        for (int j = 0; keywords[j]; j++)
+        state = editorRowPrev(chunks[c].first)->hl_state;
+        unsigned char guessed = chunks[c].state;
+
+        Row *r = chunks[c].first;
+        for (int i = 0; i < chunks[c].count && state != guessed; i++, r = editorRowNext(r))
         {
-            int klen = strlen(keywords[j]);
-
-            if (!memcmp(s->r_current, keywords[j], klen) && is_separator(*(s->r_current + klen)))
-            {
-                switch (groups[i].type)
-                {
-                case GROUP_TYPE_NORMAL:
-                    if (!is_separator(*(s->r_current + klen))) continue;
-                    break;
-                case GROUP_TYPE_FUNCTION:
-                    if (*(s->r_current + klen) != '(') continue;
-                    break;
-                case GROUP_TYPE_FORCE:
-                    break;
-                default:
-                    continue;
-                }
-
-                memset(s->hl_current, groups[i].color, klen);
-                s->r_current += klen;
-                s->hl_current += klen;
-                s->prev_sep = 0;
-                return true;
-            }
+            guessed = r->hl_state;
+
+            editorRowChanged(r);
+            state = lexRow(buf, r, state);
+            r->hl_state = state;
         }
     }
-    return false;
+
+    Row *next = editorRowNext(last);
+    if (next != NULL && last->hl_state != last_state)
+        next->flags |= ROW_HL_STALE;
 }
 
-void editorUpdateSyntax(TextBuffer *buf, int row_idx)
+/* Bring the render and the highlight of row up to date. The rows from
+ * the frontier down to it are walked in order, but only the stale ones
+ * are highlighted again: once the state at the end of a row is unchanged,
+ * the rows below are skipped until the next one that has been modified. */
+void editorHighlightRow(TextBuffer *buf, Row *row)
 {
-    Row *row = &buf->rows[row_idx];
-    Syntax *syntax = buf->syntax;
+    editorRenderRow(buf, row);
 
-    if (syntax == NULL)
+    if (buf->syntax == NULL)
         return;
 
-    HighlightState s;
-    s.row = row;
-    s.syntax = syntax;
-    s.r_current = row->render.c;
-    s.hl_current = row->render.hl;
-    s.in_string = 0;
-    s.in_comment = (row->idx > 0 && editorRowHasOpenComment(&buf->rows[row->idx - 1]));
-    s.prev_sep = 1;
+    int idx = editorRowIndex(row);
+    if (idx < buf->hl_frontier)
+        return;
 
-    while (*s.r_current && isspace(*s.r_current))
-    {
-        s.r_current++;
-        s.hl_current++;
-    }
+    Row *r = editorGetRow(buf, buf->hl_frontier);
+    Row *prev = editorRowPrev(r);
+    unsigned char state = prev ? prev->hl_state : HL_STATE_NORMAL;
 
-    while (*s.r_current)
+    if (idx - buf->hl_frontier >= HL_PARALLEL_MIN_ROWS && work_pool_threads() > 0)
     {
-        if (Highlight_Skip(&s))               continue;
-        if (Highlight_MultiLineComment(&s))   continue;
-        if (Highlight_SingleLineComment(&s))  break;
-        if (Highlight_String(&s))             continue;
-        if (Highlight_Number(&s))             continue;
-        if (Highlight_Keywords(&s))           continue;
-
-        s.prev_sep = is_separator(*s.r_current);
-        s.r_current++;
-        s.hl_current++;
+        highlightParallel(buf, buf->hl_frontier, idx, state);
+        buf->hl_frontier = idx + 1;
+        return;
     }
 
-    if (editorRowHasOpenComment(row) && row->idx + 1 < buf->numrows)
+    for (int i = buf->hl_frontier; i <= idx; i++, r = editorRowNext(r))
     {
-        editorUpdateSyntax(buf, row->idx + 1);
+        if (r->flags & ROW_HL_STALE)
+            highlightRow(buf, r, state);
+
+        state = r->hl_state;
     }
+
+    buf->hl_frontier = idx + 1;
 }
 
 Style editorSyntaxToColor(unsigned char hl)
@@ -455,6 +409,8 @@ Style editorSyntaxToColor(unsigned char hl)
         return (Style){COLOR_RED, COLOR_BLACK, 0};
     case HL_MATCH:
         return (Style){COLOR_BLUE, COLOR_BLACK, ATTR_INVERSE};
+    case HL_MATCH_OTHER:
+        return (Style){COLOR_BLACK, COLOR_BRIGHT_BLACK, 0};
     case HL_TAB:
         return (Style){COLOR_RED, COLOR_YELLOW, 0};
     default:
@@ -462,43 +418,60 @@ Style editorSyntaxToColor(unsigned char hl)
     }
 }
 
-static bool matchExtension(const char *filename, const char *extension)
+/* Compile the keyword lists of a syntax into a single trie, so that a
+ * token is classified in one pass over its bytes. Keywords keep the
+ * priority of their position in the groups. */
+static void buildKeywords(Syntax *syntax)
 {
-    int flen = strlen(filename);
-    int elen = strlen(extension);
+    size_t keywords = 0, bytes = 0;
+    for (size_t i = 0; i < syntax->group_num; i++)
+    {
+        for (int j = 0; syntax->groups[i].keywords[j]; j++)
+        {
+            keywords++;
+            bytes += strlen(syntax->groups[i].keywords[j]);
+        }
+    }
 
-    if (flen < elen)
-        return false;
+    syntax->keywords = keywordTrieCreate(keywords, bytes);
+    if (syntax->keywords == NULL)
+        return; // TODO: handle memory error
 
-    for (int i = 0; i < elen; i++)
+    for (size_t i = 0; i < syntax->group_num; i++)
     {
-        if (filename[flen - 1 - i] != extension[elen - 1 - i])
-            return false;
+        SyntaxGroup *group = &syntax->groups[i];
+        for (int j = 0; group->keywords[j]; j++)
+        {
+            keywordTrieAdd(syntax->keywords, group->keywords[j], group->color,
+                           group->type == GROUP_TYPE_FUNCTION);
+        }
     }
+}
 
-    return true;
+static void selectSyntax(TextBuffer *buf, Syntax *syntax)
+{
+    if (syntax->lexer == NULL)
+    {
+        buildKeywords(syntax);
+
+        syntax->lexer = lexerCreate(syntax);
+        if (syntax->lexer == NULL)
+            return; // TODO: handle memory error
+    }
+
+    buf->syntax = syntax;
 }
 
 void editorSelectSyntaxHighlight(TextBuffer *buf, const char *filename)
 {
-    for (size_t j = 0; j < sizeof(HLDB) / sizeof(HLDB[0]); j++)
+    static bool loaded = false;
+    if (!loaded)
     {
-        Syntax *s = HLDB + j;
-        for (size_t i = 0; s->filematch[i]; i++)
-        {
-            if (s->filematch[i][0] == '.')
-            {
-                if (matchExtension(filename, s->filematch[i]))
-                {
-                    buf->syntax = s;
-                    return;
-                }
-            }
-            else if (strcmp(filename, s->filematch[i]) == 0)
-            {
-                buf->syntax = s;
-                return;
-            }
-        }
+        syntaxDBInit(HLDB, sizeof(HLDB) / sizeof(HLDB[0]));
+        loaded = true;
     }
+
+    Syntax *syntax = syntaxDBLookup(filename);
+    if (syntax != NULL)
+        selectSyntax(buf, syntax);
 }
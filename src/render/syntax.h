@@ -4,8 +4,10 @@
 #include "color.h"
 
 typedef struct TextBuffer TextBuffer;
+typedef struct Row Row;
 typedef struct Style Style;
-typedef struct SyntaxGroup SyntaxGroup;
+typedef struct KeywordTrie KeywordTrie;
+typedef struct Lexer Lexer;
 
 enum HL
 {
@@ -21,9 +23,35 @@ enum HL
     HL_STRING,
     HL_NUMBER,
     HL_MATCH,
+    HL_MATCH_OTHER,
     HL_TAB
 };
 
+enum HL_Flags
+{
+    HL_HIGHLIGHT_STRINGS = (1 << 0),
+    HL_HIGHLIGHT_NUMBERS = (1 << 1)
+};
+
+/* Lexer state at the end of a row, the next one starts from it */
+enum HL_State
+{
+    HL_STATE_NORMAL = 0,
+    HL_STATE_COMMENT,
+    HL_STATE_UNKNOWN = 0xff  /* Never highlighted */
+};
+
+#define GROUP_TYPE_NORMAL 0
+#define GROUP_TYPE_FUNCTION 1
+#define GROUP_TYPE_FORCE 2
+
+typedef struct SyntaxGroup
+{
+    char **keywords;
+    Color color;
+    uint8_t type;
+} SyntaxGroup;
+
 typedef struct Syntax
 {
     char **filematch;
@@ -33,10 +61,13 @@ typedef struct Syntax
     char multiline_comment_start[3];
     char multiline_comment_end[3];
     int flags;
+    KeywordTrie *keywords; /* Built from groups when first selected */
+    Lexer *lexer;          /* Built from the rest when first selected */
 } Syntax;
 
 void editorSelectSyntaxHighlight(TextBuffer *buf, const char *filename);
 Style editorSyntaxToColor(unsigned char hl);
-void editorUpdateSyntax(TextBuffer *buf, int row_idx);
+void editorUpdateSyntax(TextBuffer *buf, Row *row);
+void editorHighlightRow(TextBuffer *buf, Row *row);
 
 #endif /* __EDITOR_SYNTAX_H */
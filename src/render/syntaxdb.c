@@ -0,0 +1,767 @@
+#include "syntaxdb.h"
+
+#include "syntax.h"
+#include "editor.h"
+#include "event.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC "EXTSYN01"
+#define CACHE_MAGIC_LEN 8
+
+/* A definition is stored in the same compact form whether it has just
+ * been parsed or comes from the cache:
+ *
+ *   int32 flags, char comment[2], char block_start[3], char block_end[3]
+ *   uint32 number of file patterns, then the patterns
+ *   uint32 number of groups, then for each group
+ *       uint8 color, uint8 type, uint32 number of keywords, the keywords
+ *
+ * Strings are NUL terminated, so the decoded Syntax points into it. */
+
+typedef struct Record
+{
+    char *data;
+    size_t len;
+    size_t cap;
+} Record;
+
+typedef struct Reader
+{
+    const char *p;
+    const char *end;
+    bool ok;
+} Reader;
+
+typedef struct CacheEntry
+{
+    const char *name;
+    int64_t mtime_sec, mtime_nsec, size;
+    uint64_t hash;
+    const char *record;
+    uint32_t record_len;
+} CacheEntry;
+
+typedef struct SyntaxMapEntry
+{
+    const char *key;
+    Syntax *syntax;
+} SyntaxMapEntry;
+
+static SyntaxMapEntry *map = NULL;
+static size_t map_mask = 0;
+
+static Syntax **loaded = NULL;
+static size_t num_loaded = 0;
+
+static void recordPut(Record *rec, const void *data, size_t len)
+{
+    if (rec->len + len > rec->cap)
+    {
+        size_t new_cap = next_capacity(rec->cap, rec->len + len);
+        char *new_data = realloc(rec->data, new_cap);
+        if (new_data == NULL)
+            return; // TODO: handle memory error
+
+        rec->data = new_data;
+        rec->cap = new_cap;
+    }
+
+    memcpy(rec->data + rec->len, data, len);
+    rec->len += len;
+}
+
+static void recordPutU32(Record *rec, uint32_t n)
+{
+    recordPut(rec, &n, sizeof(n));
+}
+
+static void recordPutString(Record *rec, const char *s)
+{
+    recordPut(rec, s, strlen(s) + 1);
+}
+
+static void readBytes(Reader *r, void *out, size_t len)
+{
+    if (!r->ok || (size_t)(r->end - r->p) < len)
+    {
+        r->ok = false;
+        memset(out, 0, len);
+        return;
+    }
+
+    memcpy(out, r->p, len);
+    r->p += len;
+}
+
+static uint32_t readU32(Reader *r)
+{
+    uint32_t n;
+    readBytes(r, &n, sizeof(n));
+    return n;
+}
+
+static const char *readString(Reader *r)
+{
+    const char *nul = r->ok ? memchr(r->p, '\0', r->end - r->p) : NULL;
+    if (nul == NULL)
+    {
+        r->ok = false;
+        return "";
+    }
+
+    const char *s = r->p;
+    r->p = nul + 1;
+    return s;
+}
+
+static uint64_t hashBytes(const char *data, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/* Read a whole file, NUL terminated */
+static char *readFile(const char *path, size_t *len)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    char *data = malloc(st.st_size + 1);
+    if (data == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    size_t total = 0;
+    while (total < (size_t)st.st_size)
+    {
+        ssize_t n = read(fd, data + total, st.st_size - total);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        total += n;
+    }
+    close(fd);
+
+    data[total] = '\0';
+    *len = total;
+    return data;
+}
+
+/* $env/name, or ~/fallback/name */
+static bool userPath(char *out, size_t size, const char *env, const char *fallback, const char *name)
+{
+    const char *base = getenv(env);
+    if (base != NULL && base[0] != '\0')
+        return snprintf(out, size, "%s/%s", base, name) < (int)size;
+
+    const char *home = getenv("HOME");
+    if (home == NULL || home[0] == '\0')
+        return false;
+
+    return snprintf(out, size, "%s/%s/%s", home, fallback, name) < (int)size;
+}
+
+/* Parse a syntax file. Every line is a directive followed by its words:
+ *
+ *   files .c .h Makefile     extensions (with the dot) or file names
+ *   comment //               single line comment, up to 2 characters
+ *   block <start> <end>      multi line comment, up to 2 characters each
+ *   strings                  highlight strings
+ *   numbers                  highlight numbers
+ *   keywords <1-5> words...  a group of keywords, with its color
+ *   functions <1-5> words... the same, only if followed by '('
+ *
+ * Lines starting with '#' are ignored. Return the line of the first
+ * error, or 0. */
+static int parseSyntax(char *text, Record *rec, const char **error)
+{
+    int32_t flags = 0;
+    char comment[2] = {0};
+    char block_start[3] = {0};
+    char block_end[3] = {0};
+    Record files = {0}, groups = {0};
+    uint32_t num_files = 0, num_groups = 0;
+    int lineno = 0;
+
+    *error = NULL;
+
+    char *next;
+    for (char *line = text; line != NULL; line = next)
+    {
+        next = strchr(line, '\n');
+        if (next != NULL)
+            *next++ = '\0';
+
+        lineno++;
+
+        char *save;
+        char *directive = strtok_r(line, " \t\r", &save);
+        if (directive == NULL || directive[0] == '#')
+            continue;
+
+        char *words[3];
+        int n = 0;
+
+        if (strcmp(directive, "files") == 0)
+        {
+            for (char *w = strtok_r(NULL, " \t\r", &save); w != NULL; w = strtok_r(NULL, " \t\r", &save))
+            {
+                recordPutString(&files, w);
+                num_files++;
+            }
+        }
+        else if (strcmp(directive, "comment") == 0 || strcmp(directive, "block") == 0)
+        {
+            bool is_block = (directive[0] == 'b');
+            while (n < 3 && (words[n] = strtok_r(NULL, " \t\r", &save)) != NULL)
+                n++;
+
+            if (n != (is_block ? 2 : 1) || strlen(words[0]) > 2 || (is_block && strlen(words[1]) > 2))
+            {
+                *error = is_block ? "expected 'block <start> <end>', up to 2 characters each"
+                                  : "expected 'comment <start>', up to 2 characters";
+                break;
+            }
+
+            if (is_block)
+            {
+                memcpy(block_start, words[0], strlen(words[0]));
+                memcpy(block_end, words[1], strlen(words[1]));
+            }
+            else
+            {
+                memcpy(comment, words[0], strlen(words[0]));
+            }
+        }
+        else if (strcmp(directive, "strings") == 0)
+        {
+            flags |= HL_HIGHLIGHT_STRINGS;
+        }
+        else if (strcmp(directive, "numbers") == 0)
+        {
+            flags |= HL_HIGHLIGHT_NUMBERS;
+        }
+        else if (strcmp(directive, "keywords") == 0 || strcmp(directive, "functions") == 0)
+        {
+            char *color = strtok_r(NULL, " \t\r", &save);
+            if (color == NULL || strlen(color) != 1 || color[0] < '1' || color[0] > '5')
+            {
+                *error = "expected a color between 1 and 5";
+                break;
+            }
+
+            uint8_t group[2] = {
+                HL_KEYWORD1 + (color[0] - '1'),
+                directive[0] == 'f' ? GROUP_TYPE_FUNCTION : GROUP_TYPE_NORMAL
+            };
+            recordPut(&groups, group, sizeof(group));
+
+            /* The count comes first, fix it up at the end */
+            size_t count_at = groups.len;
+            uint32_t count = 0;
+            recordPutU32(&groups, 0);
+
+            for (char *w = strtok_r(NULL, " \t\r", &save); w != NULL; w = strtok_r(NULL, " \t\r", &save))
+            {
+                recordPutString(&groups, w);
+                count++;
+            }
+
+            if (groups.data != NULL)
+                memcpy(groups.data + count_at, &count, sizeof(count));
+            num_groups++;
+        }
+        else
+        {
+            *error = "unknown directive";
+            break;
+        }
+    }
+
+    if (*error == NULL && num_files == 0)
+    {
+        *error = "no 'files' directive";
+        lineno = 1;
+    }
+
+    if (*error == NULL)
+    {
+        recordPut(rec, &flags, sizeof(flags));
+        recordPut(rec, comment, sizeof(comment));
+        recordPut(rec, block_start, sizeof(block_start));
+        recordPut(rec, block_end, sizeof(block_end));
+        recordPutU32(rec, num_files);
+        recordPut(rec, files.data, files.len);
+        recordPutU32(rec, num_groups);
+        recordPut(rec, groups.data, groups.len);
+    }
+
+    free(files.data);
+    free(groups.data);
+
+    return *error ? lineno : 0;
+}
+
+/* Build a Syntax out of a record. Everything, the record included, lives
+ * in one block: check the record and count what it holds first. */
+static Syntax *decodeSyntax(const char *record, size_t len)
+{
+    Reader r = {.p = record, .end = record + len, .ok = true};
+    char header[sizeof(int32_t) + 8];
+
+    readBytes(&r, header, sizeof(header));
+
+    uint32_t num_files = readU32(&r);
+    for (uint32_t i = 0; i < num_files && r.ok; i++)
+        readString(&r);
+
+    uint32_t num_groups = readU32(&r);
+    size_t num_keywords = 0;
+    for (uint32_t i = 0; i < num_groups && r.ok; i++)
+    {
+        uint8_t group[2];
+        readBytes(&r, group, sizeof(group));
+
+        uint32_t count = readU32(&r);
+        for (uint32_t j = 0; j < count && r.ok; j++)
+            readString(&r);
+        num_keywords += count;
+    }
+
+    if (!r.ok || r.p != r.end || num_files == 0)
+        return NULL;
+
+    size_t pointers = (num_files + 1) + num_keywords + num_groups;
+    char *block = malloc(sizeof(Syntax) + num_groups * sizeof(SyntaxGroup) + pointers * sizeof(char *) + len);
+    if (block == NULL)
+        return NULL; // TODO: handle memory error
+
+    Syntax *syntax = (Syntax *)block;
+    SyntaxGroup *groups = (SyntaxGroup *)(syntax + 1);
+    char **ptr = (char **)(groups + num_groups);
+    char *data = (char *)(ptr + pointers);
+    memcpy(data, record, len);
+
+    r = (Reader){.p = data, .end = data + len, .ok = true};
+
+    memset(syntax, 0, sizeof(Syntax));
+
+    int32_t flags;
+    readBytes(&r, &flags, sizeof(flags));
+    syntax->flags = flags;
+    readBytes(&r, syntax->singleline_comment_start, 2);
+    readBytes(&r, syntax->multiline_comment_start, 3);
+    readBytes(&r, syntax->multiline_comment_end, 3);
+    syntax->multiline_comment_start[2] = '\0';
+    syntax->multiline_comment_end[2] = '\0';
+
+    readU32(&r);
+    syntax->filematch = ptr;
+    for (uint32_t i = 0; i < num_files; i++)
+        *ptr++ = (char *)readString(&r);
+    *ptr++ = NULL;
+
+    readU32(&r);
+    syntax->groups = groups;
+    syntax->group_num = num_groups;
+    for (uint32_t i = 0; i < num_groups; i++)
+    {
+        uint8_t group[2];
+        readBytes(&r, group, sizeof(group));
+
+        groups[i].color = group[0];
+        groups[i].type = group[1];
+        groups[i].keywords = ptr;
+
+        uint32_t count = readU32(&r);
+        for (uint32_t j = 0; j < count; j++)
+            *ptr++ = (char *)readString(&r);
+        *ptr++ = NULL;
+    }
+
+    return syntax;
+}
+
+/* The entries of the cache point into data */
+static CacheEntry *readCache(const char *data, size_t len, size_t *count)
+{
+    Reader r = {.p = data, .end = data + len, .ok = true};
+    char magic[CACHE_MAGIC_LEN];
+
+    readBytes(&r, magic, sizeof(magic));
+    if (!r.ok || memcmp(magic, CACHE_MAGIC, CACHE_MAGIC_LEN) != 0)
+        return NULL;
+
+    uint32_t n = readU32(&r);
+    if (!r.ok || n > len)
+        return NULL;
+
+    CacheEntry *entries = malloc((n ? n : 1) * sizeof(CacheEntry));
+    if (entries == NULL)
+        return NULL;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        CacheEntry *e = &entries[i];
+        e->name = readString(&r);
+        readBytes(&r, &e->mtime_sec, sizeof(e->mtime_sec));
+        readBytes(&r, &e->mtime_nsec, sizeof(e->mtime_nsec));
+        readBytes(&r, &e->size, sizeof(e->size));
+        readBytes(&r, &e->hash, sizeof(e->hash));
+        e->record_len = readU32(&r);
+        e->record = r.p;
+
+        if (!r.ok || (size_t)(r.end - r.p) < e->record_len)
+        {
+            free(entries);
+            return NULL;
+        }
+        r.p += e->record_len;
+    }
+
+    *count = n;
+    return entries;
+}
+
+/* Write to a temporary file first, so that a cache is always complete */
+static void writeCache(const char *path, const CacheEntry *entries, size_t count)
+{
+    Record out = {0};
+    recordPut(&out, CACHE_MAGIC, CACHE_MAGIC_LEN);
+    recordPutU32(&out, count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const CacheEntry *e = &entries[i];
+        recordPutString(&out, e->name);
+        recordPut(&out, &e->mtime_sec, sizeof(e->mtime_sec));
+        recordPut(&out, &e->mtime_nsec, sizeof(e->mtime_nsec));
+        recordPut(&out, &e->size, sizeof(e->size));
+        recordPut(&out, &e->hash, sizeof(e->hash));
+        recordPutU32(&out, e->record_len);
+        recordPut(&out, e->record, e->record_len);
+    }
+
+    /* Create the directories of the cache */
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *slash = strchr(tmp + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+    {
+        *slash = '\0';
+        mkdir(tmp, 0755);
+        *slash = '/';
+    }
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+    {
+        free(out.data);
+        return;
+    }
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd != -1)
+    {
+        bool ok = (out.data != NULL && writen(fd, out.data, out.len) == (ssize_t)out.len);
+        close(fd);
+
+        if (!ok || rename(tmp, path) == -1)
+            unlink(tmp);
+    }
+
+    free(out.data);
+}
+
+static int compareNames(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* The names of the syntax files in dir, sorted */
+static char **listSyntaxFiles(const char *dir, size_t *count)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        return NULL;
+
+    char **names = NULL;
+    size_t n = 0, cap = 0;
+    size_t ext_len = strlen(SYNTAX_FILE_EXT);
+
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL)
+    {
+        size_t len = strlen(ent->d_name);
+        if (len <= ext_len || strcmp(ent->d_name + len - ext_len, SYNTAX_FILE_EXT) != 0)
+            continue;
+
+        if (n == cap)
+        {
+            cap = next_capacity(cap, n + 1);
+            char **new_names = realloc(names, cap * sizeof(char *));
+            if (new_names == NULL)
+                break; // TODO: handle memory error
+            names = new_names;
+        }
+
+        names[n] = strdup(ent->d_name);
+        if (names[n] != NULL)
+            n++;
+    }
+    closedir(d);
+
+    qsort(names, n, sizeof(char *), compareNames);
+
+    *count = n;
+    return names;
+}
+
+/* Tell if the cache holds exactly these entries, in the same order. A file
+ * that doesn't parse is in neither, so it doesn't make the cache stale. */
+static bool sameEntries(const CacheEntry *a, size_t na, const CacheEntry *b, size_t nb)
+{
+    if (na != nb)
+        return false;
+
+    for (size_t i = 0; i < na; i++)
+    {
+        if (strcmp(a[i].name, b[i].name) != 0 || a[i].mtime_sec != b[i].mtime_sec ||
+            a[i].mtime_nsec != b[i].mtime_nsec || a[i].size != b[i].size || a[i].hash != b[i].hash)
+            return false;
+    }
+
+    return true;
+}
+
+/* Load the syntax files of the config directory, parsing only those that
+ * changed since the cache was written */
+static void loadSyntaxFiles(void)
+{
+    char dir[PATH_MAX], cache_path[PATH_MAX];
+    if (!userPath(dir, sizeof(dir), "XDG_CONFIG_HOME", ".config", SYNTAX_DIR) ||
+        !userPath(cache_path, sizeof(cache_path), "XDG_CACHE_HOME", ".cache", SYNTAX_CACHE))
+        return;
+
+    size_t num_files = 0;
+    char **names = listSyntaxFiles(dir, &num_files);
+    if (names == NULL)
+        return;
+
+    size_t cache_len = 0, num_cached = 0;
+    char *cache = readFile(cache_path, &cache_len);
+    CacheEntry *cached = cache ? readCache(cache, cache_len, &num_cached) : NULL;
+
+    CacheEntry *entries = calloc(num_files ? num_files : 1, sizeof(CacheEntry));
+    char **texts = calloc(num_files ? num_files : 1, sizeof(char *));
+    Record *records = calloc(num_files ? num_files : 1, sizeof(Record));
+    loaded = calloc(num_files ? num_files : 1, sizeof(Syntax *));
+    if (!entries || !texts || !records || !loaded)
+        goto out; // TODO: handle memory error
+
+    size_t n = 0;
+
+    /* The first parse error is shown, with the number of the others */
+    char first_error[EDITOR_STATUSMSG_LENGTH];
+    size_t num_errors = 0;
+
+    for (size_t i = 0; i < num_files; i++)
+    {
+        char path[PATH_MAX];
+        struct stat st;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, names[i]) >= (int)sizeof(path) || stat(path, &st) == -1)
+            continue;
+
+        CacheEntry *e = &entries[n];
+        *e = (CacheEntry){
+            .name = names[i],
+            .mtime_sec = st.st_mtim.tv_sec,
+            .mtime_nsec = st.st_mtim.tv_nsec,
+            .size = st.st_size
+        };
+
+        const CacheEntry *old = NULL;
+        for (size_t j = 0; j < num_cached; j++)
+        {
+            if (strcmp(cached[j].name, names[i]) == 0)
+            {
+                old = &cached[j];
+                break;
+            }
+        }
+
+        bool fresh = old && old->mtime_sec == e->mtime_sec &&
+                     old->mtime_nsec == e->mtime_nsec && old->size == e->size;
+
+        if (!fresh)
+        {
+            size_t len;
+            texts[i] = readFile(path, &len);
+            if (texts[i] == NULL)
+                continue;
+
+            e->hash = hashBytes(texts[i], len);
+
+            /* Only touched, the definition is the same */
+            fresh = old && old->hash == e->hash && old->size == e->size;
+        }
+
+        if (fresh)
+        {
+            e->hash = old->hash;
+            e->record = old->record;
+            e->record_len = old->record_len;
+        }
+        else
+        {
+            const char *error;
+            int line = parseSyntax(texts[i], &records[i], &error);
+            if (line != 0)
+            {
+                if (num_errors++ == 0)
+                    snprintf(first_error, sizeof(first_error), "%s:%d: %s", names[i], line, error);
+                continue;
+            }
+
+            e->record = records[i].data;
+            e->record_len = records[i].len;
+        }
+
+        Syntax *syntax = decodeSyntax(e->record, e->record_len);
+        if (syntax == NULL)
+            continue;
+
+        loaded[num_loaded++] = syntax;
+        n++;
+    }
+
+    if (num_errors == 1)
+        editorFlashStatusMessage("%s", first_error);
+    else if (num_errors > 1)
+        editorFlashStatusMessage("%s (and %zu more syntax errors)", first_error, num_errors - 1);
+
+    if (!sameEntries(entries, n, cached, num_cached))
+        writeCache(cache_path, entries, n);
+
+out:
+    for (size_t i = 0; i < num_files; i++)
+    {
+        free(names[i]);
+        if (texts)
+            free(texts[i]);
+        if (records)
+            free(records[i].data);
+    }
+    free(names);
+    free(texts);
+    free(records);
+    free(entries);
+    free(cached);
+    free(cache);
+}
+
+static size_t hashKey(const char *key)
+{
+    return (size_t)hashBytes(key, strlen(key));
+}
+
+static void mapInsert(const char *key, Syntax *syntax)
+{
+    size_t i = hashKey(key) & map_mask;
+    while (map[i].key != NULL)
+    {
+        /* The first syntax to claim a pattern keeps it */
+        if (strcmp(map[i].key, key) == 0)
+            return;
+        i = (i + 1) & map_mask;
+    }
+
+    map[i] = (SyntaxMapEntry){.key = key, .syntax = syntax};
+}
+
+static Syntax *mapGet(const char *key)
+{
+    size_t i = hashKey(key) & map_mask;
+    while (map[i].key != NULL)
+    {
+        if (strcmp(map[i].key, key) == 0)
+            return map[i].syntax;
+        i = (i + 1) & map_mask;
+    }
+
+    return NULL;
+}
+
+/* Load the user syntaxes and index them with the built in ones. User
+ * syntaxes come first, so they can take over an extension. */
+void syntaxDBInit(Syntax *builtin, size_t count)
+{
+    loadSyntaxFiles();
+
+    size_t patterns = 0;
+    for (size_t i = 0; i < num_loaded + count; i++)
+    {
+        Syntax *s = i < num_loaded ? loaded[i] : &builtin[i - num_loaded];
+        for (size_t j = 0; s->filematch[j]; j++)
+            patterns++;
+    }
+
+    size_t slots = 16;
+    while (slots < 2 * patterns)
+        slots <<= 1;
+
+    map = calloc(slots, sizeof(SyntaxMapEntry));
+    if (map == NULL)
+        return; // TODO: handle memory error
+    map_mask = slots - 1;
+
+    for (size_t i = 0; i < num_loaded + count; i++)
+    {
+        Syntax *s = i < num_loaded ? loaded[i] : &builtin[i - num_loaded];
+        for (size_t j = 0; s->filematch[j]; j++)
+            mapInsert(s->filematch[j], s);
+    }
+}
+
+/* Patterns starting with a dot match the end of the file name, the
+ * others all of it. Longer extensions win, ".tar.gz" before ".gz". */
+Syntax *syntaxDBLookup(const char *filename)
+{
+    if (map == NULL)
+        return NULL;
+
+    for (const char *ext = strchr(filename, '.'); ext != NULL; ext = strchr(ext + 1, '.'))
+    {
+        Syntax *syntax = mapGet(ext);
+        if (syntax != NULL)
+            return syntax;
+    }
+
+    return mapGet(filename);
+}
@@ -0,0 +1,22 @@
+#ifndef __EDITOR_SYNTAXDB_H
+#define __EDITOR_SYNTAXDB_H
+
+#include <stddef.h>
+
+/* Besides the built in syntaxes, definitions are loaded from the *.syntax
+ * files in $XDG_CONFIG_HOME/extase/syntax (~/.config/extase/syntax). Each
+ * file is parsed once: the result is kept in a binary cache, in
+ * $XDG_CACHE_HOME/extase (~/.cache/extase), and reused as long as the
+ * mtime, size or content hash of the file match. Syntaxes are found by
+ * file name through a hash map of their extensions. */
+
+#define SYNTAX_DIR "extase/syntax"
+#define SYNTAX_CACHE "extase/syntax.cache"
+#define SYNTAX_FILE_EXT ".syntax"
+
+typedef struct Syntax Syntax;
+
+void syntaxDBInit(Syntax *builtin, size_t count);
+Syntax *syntaxDBLookup(const char *filename);
+
+#endif /* __EDITOR_SYNTAXDB_H */
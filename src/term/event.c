@@ -7,11 +7,16 @@
 #include "window.h"
 #include "fb.h"
 #include "widget.h"
+#include "loop.h"
 
 #include <stdio.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 
 void editorProcessKeypress(int fd)
 {
@@ -32,6 +37,29 @@ void editorProcessKeypress(int fd)
     windowProcessKeypress(key);
 }
 
+static long elapsedMs(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/* Wait for a key, then go on with the keys already queued, so a burst of
+ * input (a paste, autorepeat) costs a single redraw. The batch is cut
+ * after E.batch_latency ms to keep the screen responsive. */
+void editorProcessInput(int fd)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    do
+    {
+        editorProcessKeypress(fd);
+    }
+    while (editorInputPending(fd) && elapsedMs(&start) < E.batch_latency);
+}
+
 void updateWindowSize(void)
 {
     if (getWindowSize(STDIN_FILENO, STDOUT_FILENO,
@@ -53,26 +81,92 @@ void updateWindowSize(void)
     computeWindowLayout();
 }
 
-void handleSigWinCh(int unused)
+/* SIGWINCH only writes a byte on this pipe. The resize is applied by the
+ * main loop, once for all the signals received since the last time. */
+static int winch_pipe[2] = {-1, -1};
+
+static void handleSigWinCh(int unused)
 {
     (void)unused;
 
+    int saved_errno = errno;
+    ssize_t ret = write(winch_pipe[1], "", 1);
+    (void)ret; /* The pipe is full, a resize is pending already */
+    errno = saved_errno;
+}
+
+static void editorResize(int fd, void *data)
+{
+    (void)data;
+
+    char drain[64];
+    while (read(fd, drain, sizeof(drain)) > 0);
+
     updateWindowSize();
-    
+
+    /* The new frame is drawn by the loop once the events are dispatched */
     if (E.too_small)
         editorTooSmallScreen();
-    else
-        editorRefreshScreen();
+}
+
+void initSigWinCh(void)
+{
+    if (pipe(winch_pipe) == -1 ||
+        fcntl(winch_pipe[0], F_SETFL, O_NONBLOCK) == -1 ||
+        fcntl(winch_pipe[1], F_SETFL, O_NONBLOCK) == -1 ||
+        editorWatchFd(winch_pipe[0], editorResize, NULL) != 0)
+    {
+        editorFatalError("Unable to watch for window resizes\n");
+        exit(EXIT_FAILURE);
+    }
+
+    signal(SIGWINCH, handleSigWinCh);
+}
+
+/* Timer that clears the last flashed status message, -1 if none */
+static int statusmsg_timer = -1;
+
+static void editorClearStatusMessage(void *data)
+{
+    (void)data;
+
+    statusmsg_timer = -1;
+    E.statusmsg[0] = '\0';
+}
+
+static void editorVSetStatusMessage(const char *fmt, va_list ap)
+{
+    /* A new message, a prompt included, must not be cleared by the timer
+     * of the previous one */
+    if (statusmsg_timer != -1)
+    {
+        editorRemoveTimer(statusmsg_timer);
+        statusmsg_timer = -1;
+    }
+
+    vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);
 }
 
 void editorSetStatusMessage(const char *fmt, ...)
 {
     va_list ap;
     va_start(ap, fmt);
-    vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);
+    editorVSetStatusMessage(fmt, ap);
     va_end(ap);
 }
 
+/* Like editorSetStatusMessage, but the message goes away by itself after
+ * EDITOR_STATUSMSG_TIMEOUT milliseconds */
+void editorFlashStatusMessage(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    editorVSetStatusMessage(fmt, ap);
+    va_end(ap);
+
+    statusmsg_timer = editorAddTimer(EDITOR_STATUSMSG_TIMEOUT, false, editorClearStatusMessage, NULL);
+}
+
 // TODO: fix this shitty error reporting system
 char errorbuffer[1024] = {0};
 
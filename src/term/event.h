@@ -2,11 +2,13 @@
 #define __EDITOR_EVENT_H
 
 void editorProcessKeypress(int fd);
+void editorProcessInput(int fd);
 
 void updateWindowSize(void);
-void handleSigWinCh(int);
+void initSigWinCh(void);
 
 void editorSetStatusMessage(const char *fmt, ...);
+void editorFlashStatusMessage(const char *fmt, ...);
 void editorFatalError(const char *fmt, ...);
 void editorPrintFatalError(void);
 
@@ -0,0 +1,205 @@
+#include "loop.h"
+
+#include "term.h"
+#include "event.h"
+#include "editor.h"
+#include "ui.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+typedef struct Watcher
+{
+    int fd;
+    WatchCallback cb;
+    void *data;
+} Watcher;
+
+typedef struct Timer
+{
+    int id;
+    long long expires; /* Milliseconds on the monotonic clock */
+    int interval;      /* 0 for one-shot timers */
+    TimerCallback cb;
+    void *data;
+} Timer;
+
+static Watcher watchers[LOOP_MAX_WATCHERS];
+static int num_watchers = 0;
+
+static Timer timers[LOOP_MAX_TIMERS];
+static int num_timers = 0;
+static int next_timer_id = 1;
+
+static long long nowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* Call cb(fd, data) from the main loop whenever fd becomes readable */
+int editorWatchFd(int fd, WatchCallback cb, void *data)
+{
+    if (num_watchers == LOOP_MAX_WATCHERS)
+        return -1;
+
+    watchers[num_watchers++] = (Watcher){.fd = fd, .cb = cb, .data = data};
+    return 0;
+}
+
+void editorUnwatchFd(int fd)
+{
+    for (int i = 0; i < num_watchers; i++)
+    {
+        if (watchers[i].fd == fd)
+        {
+            watchers[i] = watchers[--num_watchers];
+            return;
+        }
+    }
+}
+
+/* Call cb(data) from the main loop in ms milliseconds, and then every ms
+ * milliseconds if repeat is set. Return the id of the timer, -1 if there
+ * are too many. */
+int editorAddTimer(int ms, bool repeat, TimerCallback cb, void *data)
+{
+    if (num_timers == LOOP_MAX_TIMERS)
+        return -1;
+
+    int id = next_timer_id++;
+    timers[num_timers++] = (Timer){
+        .id = id,
+        .expires = nowMs() + ms,
+        .interval = repeat ? ms : 0,
+        .cb = cb,
+        .data = data
+    };
+
+    return id;
+}
+
+void editorRemoveTimer(int id)
+{
+    for (int i = 0; i < num_timers; i++)
+    {
+        if (timers[i].id == id)
+        {
+            timers[i] = timers[--num_timers];
+            return;
+        }
+    }
+}
+
+/* Milliseconds until the next timer expires, -1 if there are none */
+static int nextTimeout(void)
+{
+    if (num_timers == 0)
+        return -1;
+
+    long long now = nowMs();
+    long long first = timers[0].expires;
+    for (int i = 1; i < num_timers; i++)
+    {
+        if (timers[i].expires < first)
+            first = timers[i].expires;
+    }
+
+    return first > now ? (int)(first - now) : 0;
+}
+
+static void runTimers(void)
+{
+    long long now = nowMs();
+
+    /* A callback may add or remove timers, so start over after each one */
+    int i = 0;
+    while (i < num_timers)
+    {
+        Timer *t = &timers[i];
+        if (t->expires > now)
+        {
+            i++;
+            continue;
+        }
+
+        TimerCallback cb = t->cb;
+        void *data = t->data;
+
+        if (t->interval > 0)
+            t->expires = now + t->interval;
+        else
+            timers[i] = timers[--num_timers];
+
+        cb(data);
+        i = 0;
+    }
+}
+
+/* Sleep until something happens and dispatch the watchers and timers that
+ * are ready. Return true if a key can be read from input_fd. */
+bool editorWaitEvents(int input_fd)
+{
+    struct pollfd pfd[LOOP_MAX_WATCHERS + 1];
+    int n = 0;
+
+    pfd[n++] = (struct pollfd){.fd = input_fd, .events = POLLIN};
+    for (int i = 0; i < num_watchers; i++)
+    {
+        pfd[n++] = (struct pollfd){.fd = watchers[i].fd, .events = POLLIN};
+    }
+
+    /* Keys already read from the terminal don't wake poll() */
+    bool buffered = editorInputBuffered();
+
+    /* A signal handler only writes on a watched pipe, poll() again to see
+     * it rather than going back to the loop with nothing done */
+    int ret;
+    do
+    {
+        ret = poll(pfd, n, buffered ? 0 : nextTimeout());
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == -1)
+    {
+        editorFatalError("Fatal: poll failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    runTimers();
+
+    for (int i = 1; i < n; i++)
+    {
+        if (!(pfd[i].revents & (POLLIN | POLLHUP | POLLERR)))
+            continue;
+
+        /* Look the watcher up again, the previous callbacks may have
+         * removed some of them */
+        for (int j = 0; j < num_watchers; j++)
+        {
+            if (watchers[j].fd == pfd[i].fd)
+            {
+                watchers[j].cb(watchers[j].fd, watchers[j].data);
+                break;
+            }
+        }
+    }
+
+    return buffered || (pfd[0].revents & (POLLIN | POLLHUP | POLLERR));
+}
+
+/* Keep the loop running until a key can be read from input_fd. Like the
+ * main loop, the screen is drawn again after the events that come first,
+ * the callbacks only update the state. */
+void editorWaitInput(int input_fd)
+{
+    while (!editorWaitEvents(input_fd))
+    {
+        if (!E.too_small)
+            editorRefreshScreen();
+    }
+}
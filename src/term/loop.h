@@ -0,0 +1,25 @@
+#ifndef __EDITOR_LOOP_H
+#define __EDITOR_LOOP_H
+
+#include <stdbool.h>
+
+/* The editor sleeps in poll() until the terminal sends a key, a watched
+ * file descriptor becomes readable or a timer expires. Watchers and timers
+ * are dispatched from the main loop, never from a signal handler. */
+
+#define LOOP_MAX_WATCHERS 16
+#define LOOP_MAX_TIMERS 16
+
+typedef void (*WatchCallback)(int fd, void *data);
+typedef void (*TimerCallback)(void *data);
+
+int editorWatchFd(int fd, WatchCallback cb, void *data);
+void editorUnwatchFd(int fd);
+
+int editorAddTimer(int ms, bool repeat, TimerCallback cb, void *data);
+void editorRemoveTimer(int id);
+
+bool editorWaitEvents(int input_fd);
+void editorWaitInput(int input_fd);
+
+#endif /* __EDITOR_LOOP_H */
@@ -3,8 +3,10 @@
 #include "editor.h"
 #include "event.h"
 #include "utils.h"
+#include "loop.h"
 
 #include <termios.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <stdlib.h>
 #include <errno.h>
@@ -72,9 +74,20 @@ static void disableAltScreen(void)
     termPrint(STDOUT_FILENO, ESC_DISABLE_ALT_SCREEN);
 }
 
+static void enableBracketedPaste(void)
+{
+    termPrint(STDOUT_FILENO, ESC_ENABLE_BRACKETED_PASTE);
+}
+
+static void disableBracketedPaste(void)
+{
+    termPrint(STDOUT_FILENO, ESC_DISABLE_BRACKETED_PASTE);
+}
+
 static void editorAtExit(void)
 {
     disableRawMode(STDIN_FILENO);
+    disableBracketedPaste();
     disableAltScreen();
 
     setCursorMode(CURSOR_DEFAULT);
@@ -112,32 +125,166 @@ int enableRawMode(int fd)
     raw.c_oflag &= ~(OPOST);
     raw.c_cflag |= (CS8);
     raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
-    raw.c_cc[VMIN] = 0;
-    raw.c_cc[VTIME] = 1;
+    /* Reads block until a byte arrives, the waiting happens in poll() */
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
 
     if (tcsetattr(fd, TCSAFLUSH, &raw) < 0)
         return -1;
 
     enableAltScreen();
+    enableBracketedPaste();
 
     E.rawmode = true;
     
     return 0;
 }
 
+#define INPUT_BUFFER_SIZE 4096
+
+/* Bytes read from the terminal but not decoded yet. Everything available
+ * is read at once, so a burst of keys costs a single read(). */
+static char input[INPUT_BUFFER_SIZE];
+static size_t input_head = 0;
+static size_t input_tail = 0;
+
+/* Wait for the rest of an escape sequence at most this many ms */
+#define ESC_SEQ_TIMEOUT 100
+
+/* Refill the input buffer once it has been consumed, waiting at most
+ * timeout milliseconds for the terminal. Return 0 if nothing arrived. */
+static size_t fillInput(int fd, int timeout)
+{
+    input_head = input_tail = 0;
+
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (poll(&pfd, 1, timeout) <= 0)
+        return 0;
+
+    ssize_t nread = read(fd, input, INPUT_BUFFER_SIZE);
+    if (nread == -1 && errno != EINTR && errno != EAGAIN)
+    {
+        editorFatalError("Unable to read key\n");
+        exit(EXIT_FAILURE);
+    }
+    if (nread == 0)
+    {
+        editorFatalError("Unable to read key: the terminal has been closed\n");
+        exit(EXIT_FAILURE);
+    }
+    if (nread < 0)
+        return 0;
+
+    input_tail = nread;
+    return nread;
+}
+
+/* Read one byte, filling the input buffer if needed. Return 0 if nothing
+ * arrived within timeout milliseconds. */
+static int readByte(int fd, char *c, int timeout)
+{
+    if (input_head == input_tail && fillInput(fd, timeout) == 0)
+        return 0;
+
+    *c = input[input_head++];
+    return 1;
+}
+
+/* Give up on a paste whose end marker does not arrive within a second */
+#define PASTE_MAX_WAIT 10
+
+/* Text of the last bracketed paste */
+static char *paste = NULL;
+static size_t paste_len = 0;
+static size_t paste_cap = 0;
+
+static void pasteAppend(const char *s, size_t len)
+{
+    if (paste_len + len > paste_cap)
+    {
+        size_t new_cap = next_capacity(paste_cap, paste_len + len);
+        char *new_paste = realloc(paste, new_cap);
+        if (!new_paste)
+        {
+            // TODO: handle memory error
+            return;
+        }
+        paste = new_paste;
+        paste_cap = new_cap;
+    }
+
+    memcpy(paste + paste_len, s, len);
+    paste_len += len;
+}
+
+/* Collect the text up to the end of a bracketed paste. Everything that is
+ * not an escape character is copied straight from the input buffer. */
+static int readPaste(int fd)
+{
+    const size_t end_len = sizeof(ESC_PASTE_END) - 1;
+    size_t matched = 0;
+    int waited = 0;
+
+    paste_len = 0;
+
+    while (matched < end_len)
+    {
+        if (input_head == input_tail && fillInput(fd, ESC_SEQ_TIMEOUT) == 0)
+        {
+            if (++waited == PASTE_MAX_WAIT)
+                break;
+            continue;
+        }
+        waited = 0;
+
+        if (matched == 0)
+        {
+            char *start = input + input_head;
+            char *esc = memchr(start, ESC, input_tail - input_head);
+            size_t n = esc ? (size_t)(esc - start) : input_tail - input_head;
+
+            pasteAppend(start, n);
+            input_head += n;
+
+            if (!esc) continue;
+        }
+
+        char c = input[input_head++];
+        if (c == ESC_PASTE_END[matched])
+        {
+            matched++;
+            continue;
+        }
+
+        /* Not the end marker after all, the bytes matched so far are text */
+        pasteAppend(ESC_PASTE_END, matched);
+        matched = (c == ESC);
+        if (!matched)
+            pasteAppend(&c, 1);
+    }
+
+    return PASTE;
+}
+
+const char *editorGetPaste(size_t *len)
+{
+    *len = paste_len;
+    return paste;
+}
+
 static int parseEsc(int fd)
 {
     char buf[10];
     size_t i = 0;
 
-    if (read(fd, buf, 1) == 0) return ESC;
+    if (readByte(fd, buf, ESC_SEQ_TIMEOUT) == 0) return ESC;
     i++;
 
     if (buf[0] == '[')
     {
         while (i < sizeof(buf) - 1)
         {
-            if (read(fd, &buf[i], 1) == 0) return ESC;
+            if (readByte(fd, &buf[i], ESC_SEQ_TIMEOUT) == 0) return ESC;
 
             if ((buf[i] >= 'A' && buf[i] <= 'Z') ||
                 (buf[i] >= 'a' && buf[i] <= 'z') ||
@@ -153,7 +300,7 @@ static int parseEsc(int fd)
         /* * It's an "O" sequence (e.g., "OH", "OF").
          * These are usually just one more character.
          */
-        if (read(fd, &buf[i], 1) == 0) return ESC;
+        if (readByte(fd, &buf[i], ESC_SEQ_TIMEOUT) == 0) return ESC;
         i++;
     }
     else
@@ -180,6 +327,8 @@ static int parseEsc(int fd)
     if (strcmp(buf, "[1;5C") == 0) return CTRL_ARROW_RIGHT;
     if (strcmp(buf, "[1;5D") == 0) return CTRL_ARROW_LEFT;
 
+    if (strcmp(buf, "[200~") == 0) return readPaste(fd);
+
     if (strcmp(buf, "OH") == 0) return HOME_KEY;
     if (strcmp(buf, "OF") == 0) return END_KEY;
 
@@ -188,14 +337,11 @@ static int parseEsc(int fd)
 
 int editorReadKey(int fd)
 {
-    int nread;
     char c;
-    while ((nread = read(fd, &c, 1)) == 0);
-    if (nread == -1)
-    {
-        editorFatalError("Unable to read key\n");
-        exit(EXIT_FAILURE);
-    }
+
+    /* Keep serving the other events while waiting for a key */
+    while (readByte(fd, &c, 0) == 0)
+        editorWaitInput(fd);
 
     while (1)
     {
@@ -210,6 +356,27 @@ int editorReadKey(int fd)
     }
 }
 
+/* Return true if keys have been read from the terminal but not decoded */
+bool editorInputBuffered(void)
+{
+    return input_head != input_tail;
+}
+
+/* Return true if a key can be read without blocking */
+bool editorInputPending(int fd)
+{
+    if (input_head != input_tail)
+        return true;
+
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/* Give up on a terminal that doesn't answer the cursor position query:
+ * raw mode reads block until a byte comes */
+#define CURSOR_POS_TIMEOUT 1000
+
 static int getCursorPosition(int ifd, int ofd, int *rows, int *cols)
 {
     char buf[32];
@@ -221,7 +388,11 @@ static int getCursorPosition(int ifd, int ofd, int *rows, int *cols)
     /* Read the response: ESC[#;#R */
     while (i < sizeof(buf) - 1)
     {
-        if (read(ifd, buf + i, 1) != 1)
+        struct pollfd pfd = {.fd = ifd, .events = POLLIN};
+        int ret;
+        while ((ret = poll(&pfd, 1, CURSOR_POS_TIMEOUT)) == -1 && errno == EINTR);
+
+        if (ret <= 0 || read(ifd, buf + i, 1) != 1)
             break;
         if (buf[i] == 'R')
             break;
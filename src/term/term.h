@@ -1,6 +1,9 @@
 #ifndef __EDITOR_TERM_H
 #define __EDITOR_TERM_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 enum KEY_ACTION
 {
     KEY_INVALID = -1,
@@ -50,7 +53,8 @@ enum KEY_ACTION
     HOME_KEY,
     END_KEY,
     PAGE_UP,
-    PAGE_DOWN
+    PAGE_DOWN,
+    PASTE           /* Bracketed paste, text from editorGetPaste() */
 };
 
 enum CursorMode
@@ -89,12 +93,22 @@ enum CursorMode
 
 #define ESC_CURSOR_HOME         "\x1b[H"
 
+#define ESC_SCROLL_REGION       "\x1b[%d;%dr"
+#define ESC_RESET_SCROLL_REGION "\x1b[r"
+
 #define ESC_ENABLE_ALT_SCREEN   "\x1b[?1049h"
 #define ESC_DISABLE_ALT_SCREEN  "\x1b[?1049l"
 
+#define ESC_ENABLE_BRACKETED_PASTE  "\x1b[?2004h"
+#define ESC_DISABLE_BRACKETED_PASTE "\x1b[?2004l"
+#define ESC_PASTE_END               "\x1b[201~"
+
 int enableRawMode(int fd);
 int getWindowSize(int ifd, int ofd, int *rows, int *cols);
 int editorReadKey(int fd);
+bool editorInputPending(int fd);
+bool editorInputBuffered(void);
+const char *editorGetPaste(size_t *len);
 
 int setCursorMode(enum CursorMode mode);
 void setCursorPosition(int fd, int row, int col);
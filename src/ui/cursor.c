@@ -25,7 +25,7 @@ void editorMoveCursorLeft(Window *W)
         else
         {
             editorMoveCursorUp(W);
-            W->cx = W->buf->rows[filerow - 1].size;
+            W->cx = editorGetRow(W->buf, filerow - 1)->size;
 
             if (W->cx > W->viewport.cols - 1)
             {
@@ -48,7 +48,7 @@ void editorMoveCursorRight(Window *W)
     int filecol = W->viewport.coloff + W->cx;
 
     TextBuffer *buf = W->buf;
-    Row *row = (filerow >= buf->numrows) ? NULL : &buf->rows[filerow];
+    Row *row = editorGetRow(buf, filerow);
 
     if (row == NULL) return;    
 
@@ -81,7 +81,7 @@ static void fixCursorX(Window *W)
 {
     int filerow = W->viewport.rowoff + W->cy;
     int filecol = W->viewport.coloff + W->expected_cx;
-    Row *row = (filerow >= W->buf->numrows) ? NULL : &W->buf->rows[filerow];
+    Row *row = editorGetRow(W->buf, filerow);
     int rowlen = row ? row->size : 0;
 
     if (filecol > rowlen)
@@ -176,8 +176,11 @@ void editorCenterCursor(Window *W)
 
 void editorMoveCursorTo(Window *W, int x, int y)
 {
-    if (x < 0 || y < 0 || 
-        y > W->buf->numrows || x > (int)W->buf->rows[y].render.size)
+    Row *row = editorGetRow(W->buf, y);
+    if (row != NULL)
+        editorRenderRow(W->buf, row);
+
+    if (x < 0 || row == NULL || x > (int)row->render.size)
         return;
     
     W->cx = x;
@@ -189,6 +192,35 @@ void editorMoveCursorTo(Window *W, int x, int y)
     editorCenterCursor(W);
 }
 
+/* Move the cursor to column x of the file row y, scrolling the viewport
+ * only as much as needed to keep it visible. */
+void editorMoveCursorToPosition(Window *W, int x, int y)
+{
+    int last = W->viewport.rows - E.scroll_margin - 1;
+    if (last < 0) last = 0;
+
+    W->cy = y - W->viewport.rowoff;
+    if (W->cy < 0)
+    {
+        W->viewport.rowoff = y;
+        W->cy = 0;
+    }
+    else if (W->cy > last)
+    {
+        W->viewport.rowoff = y - last;
+        W->cy = last;
+    }
+
+    if (x < W->viewport.coloff || x - W->viewport.coloff > W->viewport.cols - 1)
+    {
+        W->viewport.coloff = x - (W->viewport.cols - 1);
+        if (W->viewport.coloff < 0) W->viewport.coloff = 0;
+    }
+    W->cx = x - W->viewport.coloff;
+
+    W->expected_cx = W->cx;
+}
+
 void editorScrollUp(Window *W)
 {
     if (W->viewport.rowoff == 0) return;
@@ -219,7 +251,7 @@ void editorMoveCursorLineEnd(Window *W)
     int filerow = W->viewport.rowoff + W->cy;
 
     TextBuffer *buf = W->buf;
-    Row *row = (filerow >= buf->numrows) ? NULL : &buf->rows[filerow];
+    Row *row = editorGetRow(buf, filerow);
 
     if (row == NULL) return;    
 
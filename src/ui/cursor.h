@@ -15,6 +15,7 @@ void editorMoveCursorPageUp(Window *W);
 void editorMoveCursorPageDown(Window *W);
 
 void editorMoveCursorTo(Window *W, int x, int y);
+void editorMoveCursorToPosition(Window *W, int x, int y);
 void editorCenterCursor(Window *W);
 
 void editorScrollUp(Window *W);
@@ -29,20 +29,25 @@ FrameBuffer *fbCreate(int rows, int cols)
     fb->rows = rows;
     fb->cols = cols;
     fb->grid = calloc(rows * cols, sizeof(Cell));
-    if (fb->grid == NULL)
+    fb->front = calloc(rows * cols, sizeof(Cell));
+    if (fb->grid == NULL || fb->front == NULL)
     {
         editorFatalError("Not enough memory to allocate the framebuffer!\n");
         exit(EXIT_FAILURE);
     }
 
+    StyleId debug_style = styleIntern((Style){COLOR_MAGENTA, COLOR_MAGENTA, 0}); /* magenta just for debugging purposes */
+
     for (int i = 0; i < rows * cols; i++) 
     {
         fb->grid[i].c = ' ';
         fb->grid[i].width = 1;
-        fb->grid[i].style.fg = COLOR_MAGENTA; /* magenta just for debugging purposes */
-        fb->grid[i].style.bg = COLOR_MAGENTA;
+        fb->grid[i].style = debug_style;
     }
 
+    fb->full_repaint = true;
+    fb->nscrolls = 0;
+
     return fb;
 }
 
@@ -53,27 +58,83 @@ void fbResize(FrameBuffer *fb, int rows, int cols)
     fb->rows = rows;
     fb->cols = cols;
     fb->grid = realloc(fb->grid, rows * cols * sizeof(Cell));
-    if (fb->grid == NULL)
+    fb->front = realloc(fb->front, rows * cols * sizeof(Cell));
+    if (fb->grid == NULL || fb->front == NULL)
     {
         editorFatalError("Not enough memory to realloc the framebuffer!\n");
         exit(EXIT_FAILURE);
     }
 
+    StyleId debug_style = styleIntern((Style){COLOR_MAGENTA, COLOR_MAGENTA, 0}); /* magenta just for debugging purposes */
+
     for (int i = 0; i < rows * cols; i++) 
     {
         fb->grid[i].c = ' ';
         fb->grid[i].width = 1;
-        fb->grid[i].style.fg = COLOR_MAGENTA; /* magenta just for debugging purposes */
-        fb->grid[i].style.bg = COLOR_MAGENTA;
+        fb->grid[i].style = debug_style;
     }
+
+    fb->full_repaint = true;
+    fb->nscrolls = 0;
 }
 
 void fbFree(FrameBuffer *fb)
 {
     free(fb->grid);
+    free(fb->front);
     free(fb);
 }
 
+/* Something else has been written on the terminal, the next fbRender()
+ * has to redraw the whole screen */
+void fbInvalidate(FrameBuffer *fb)
+{
+    if (fb != NULL)
+        fb->full_repaint = true;
+}
+
+static void fbShiftRows(FrameBuffer *fb, Cell *grid, int top, int bottom, int n)
+{
+    int rows = bottom - top + 1 - abs(n);
+    size_t rowsize = fb->cols * sizeof(Cell);
+
+    if (n > 0)
+        memmove(&grid[top*fb->cols], &grid[(top + n)*fb->cols], rows * rowsize);
+    else
+        memmove(&grid[(top - n)*fb->cols], &grid[top*fb->cols], rows * rowsize);
+}
+
+/* The content of the rows [top, bottom] moves up by n rows (down if n is
+ * negative), as it happens when a full width window scrolls. Both grids
+ * are shifted and fbRender() will have the terminal scroll them with a
+ * scroll region, so only the exposed rows have to be sent. The exposed
+ * rows of the front buffer are marked as never matching. Return false
+ * if the scroll can't be done, nothing is changed then. */
+bool fbScrollRows(FrameBuffer *fb, int top, int bottom, int n)
+{
+    if (top < 0 || bottom >= fb->rows || top > bottom || n == 0 || abs(n) > bottom - top)
+        return false;
+
+    if (!fb->full_repaint)
+    {
+        if (fb->nscrolls == FB_MAX_SCROLLS)
+            return false;
+
+        fb->scrolls[fb->nscrolls++] = (ScrollOp){top, bottom, n};
+        fbShiftRows(fb, fb->front, top, bottom, n);
+
+        int first = (n > 0) ? bottom - n + 1 : top;
+        for (int i = first*fb->cols; i < (first + abs(n))*fb->cols; i++)
+        {
+            fb->front[i].c = UINT32_MAX;
+        }
+    }
+
+    fbShiftRows(fb, fb->grid, top, bottom, n);
+
+    return true;
+}
+
 void fbPutCodepoint(FrameBuffer *fb, int x, int y, uint32_t c, Style style)
 {
     if (x < 0 || y < 0 || y >= fb->rows || x >= fb->cols) return;
@@ -91,15 +152,17 @@ void fbPutCodepoint(FrameBuffer *fb, int x, int y, uint32_t c, Style style)
         return; /* we clip it, we can't draw it */
     }
 
+    StyleId id = styleIntern(style);
+
     fb->grid[y*fb->cols + x].c = c;
-    fb->grid[y*fb->cols + x].style = style;
+    fb->grid[y*fb->cols + x].style = id;
     fb->grid[y*fb->cols + x].width = width;
 
     // If it was a wide character, place a "dummy" cell in the next slot
     if (width == 2)
     {
         fb->grid[y*fb->cols + x + 1].c = 0;
-        fb->grid[y*fb->cols + x + 1].style = style;
+        fb->grid[y*fb->cols + x + 1].style = id;
         fb->grid[y*fb->cols + x + 1].width = 0;
     }
 }
@@ -255,56 +318,86 @@ void abFree(AppendBuffer *ab)
     free(ab->b);
 }
 
+static bool fbCellEqual(const Cell *a, const Cell *b)
+{
+    return a->c == b->c && a->width == b->width && a->style == b->style;
+}
+
+/* Emit the cells of the back buffer that differ from the front buffer,
+ * moving the cursor only when the next changed cell is not where the
+ * previous one left it. With full_repaint set every cell is emitted.
+ * The scrolls recorded by fbScrollRows() are sent first. */
 void fbRender(FrameBuffer *fb, AppendBuffer *ab)
 {
-    abAppendString(ab, ESC_CURSOR_HOME);
+    bool full = fb->full_repaint;
 
-    Style last_style;
-    bool first_cell = true;
+    if (full)
+        abAppendString(ab, ESC_CURSOR_HOME);
 
-    int i = 0;
-    while (i < fb->rows * fb->cols)
+    for (int i = 0; i < fb->nscrolls && !full; i++)
     {
-        Cell *cell = &fb->grid[i];
-
-        /* Skip dummy cells */
-        if (cell->width == 0)
-        {
-            i++;
-            continue;
-        }
+        ScrollOp *op = &fb->scrolls[i];
+        char seq[48];
 
-        Style *s = &cell->style;
-
-        if (first_cell || s->bg != last_style.bg || s->fg != last_style.fg || 
-            s->attr != last_style.attr)
-        {
-            char seq[64];
-            int len = 0;
-
-            len += snprintf(seq + len, sizeof(seq) - len, "\x1b["ESC_RESET_MODES);
+        snprintf(seq, sizeof(seq), ESC_SCROLL_REGION "\x1b[%d%c" ESC_RESET_SCROLL_REGION,
+                 op->top + 1, op->bottom + 1, abs(op->n), (op->n > 0) ? 'S' : 'T');
+        abAppendString(ab, seq);
+    }
+    fb->nscrolls = 0;
 
-            if (s->attr & ATTR_BOLD)        len += snprintf(seq + len, sizeof(seq) - len, ";"ESC_BOLD);
-            if (s->attr & ATTR_DIM)         len += snprintf(seq + len, sizeof(seq) - len, ";"ESC_DIM);
-            if (s->attr & ATTR_ITALIC)      len += snprintf(seq + len, sizeof(seq) - len, ";"ESC_ITALIC);
-            if (s->attr & ATTR_UNDERLINE)   len += snprintf(seq + len, sizeof(seq) - len, ";"ESC_UNDERLINE);
-            if (s->attr & ATTR_BLINK)       len += snprintf(seq + len, sizeof(seq) - len, ";"ESC_BLINKING);
-            if (s->attr & ATTR_INVERSE)     len += snprintf(seq + len, sizeof(seq) - len, ";"ESC_INVERSE);
+    StyleId last_style = 0;
+    bool first_cell = true;
 
-            len += printFgColor(seq+len, sizeof(seq)-len, E.color_mode, s->fg);
-            len += printBgColor(seq+len, sizeof(seq)-len, E.color_mode, s->bg);
-            len += snprintf(seq + len, sizeof(seq) - len, "m");
+    styleSetColorMode(E.color_mode);
 
-            abAppendString(ab, seq);
+    for (int y = 0; y < fb->rows; y++)
+    {
+        int cur_x = full ? 0 : -1; /* Where the terminal cursor is on this row */
 
-            first_cell = false;
-            last_style = *s;
+        int x = 0;
+        while (x < fb->cols)
+        {
+            int i = y*fb->cols + x;
+            Cell *cell = &fb->grid[i];
+
+            /* Skip dummy cells */
+            if (cell->width == 0)
+            {
+                x++;
+                continue;
+            }
+
+            if (!full && fbCellEqual(cell, &fb->front[i]))
+            {
+                x += cell->width;
+                continue;
+            }
+
+            if (cur_x != x)
+            {
+                char pos[32];
+                snprintf(pos, sizeof(pos), "\x1b[%d;%dH", y + 1, x + 1);
+                abAppendString(ab, pos);
+            }
+
+            if (first_cell || cell->style != last_style)
+            {
+                char seq[STYLE_SGR_MAX];
+                abAppend(ab, seq, styleTransition(seq, last_style, cell->style, first_cell));
+
+                first_cell = false;
+                last_style = cell->style;
+            }
+
+            char utf8_buffer[5]; /* (Max 4 bytes + null) */
+            int bytes_written = codepoint_to_utf8(cell->c, utf8_buffer);
+            abAppend(ab, utf8_buffer, bytes_written);
+
+            x += cell->width;
+            cur_x = x;
         }
-
-        char utf8_buffer[5]; /* (Max 4 bytes + null) */
-        int bytes_written = codepoint_to_utf8(cell->c, utf8_buffer);
-        abAppend(ab, utf8_buffer, bytes_written);
-
-        i += cell->width;
     }
+
+    memcpy(fb->front, fb->grid, fb->rows * fb->cols * sizeof(Cell));
+    fb->full_repaint = false;
 }
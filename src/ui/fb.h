@@ -5,6 +5,7 @@
 #include <stddef.h>
 
 #include "color.h"
+#include "style.h"
 
 typedef struct Window Window;
 
@@ -12,14 +13,27 @@ typedef struct Cell
 {
     uint32_t c;
     uint8_t width;
-    Style style;
+    StyleId style;
 } Cell;
 
+#define FB_MAX_SCROLLS 4
+
+/* Rows [top, bottom] moved up by n rows, down if n is negative */
+typedef struct ScrollOp
+{
+    int top, bottom;
+    int n;
+} ScrollOp;
+
 typedef struct FrameBuffer
 {
     int rows;
     int cols;
-    Cell *grid;
+    Cell *grid;        /* Back buffer, where the next frame is drawn */
+    Cell *front;       /* What the terminal is showing */
+    bool full_repaint; /* The front buffer can't be trusted, redraw every cell */
+    ScrollOp scrolls[FB_MAX_SCROLLS]; /* To be done by the terminal before drawing */
+    int nscrolls;
 } FrameBuffer;
 
 typedef struct AppendBuffer
@@ -34,6 +48,8 @@ typedef struct AppendBuffer
 FrameBuffer *fbCreate(int rows, int cols);
 void fbResize(FrameBuffer *fb, int rows, int cols);
 void fbFree(FrameBuffer *fb);
+void fbInvalidate(FrameBuffer *fb);
+bool fbScrollRows(FrameBuffer *fb, int top, int bottom, int n);
 
 void fbPutChar(FrameBuffer *fb, int x, int y, char c, Style style);
 void fbPutCodepoint(FrameBuffer *fb, int x, int y, uint32_t c, Style style);
@@ -140,6 +140,8 @@ void computeWindowLayout(void)
     layout_root->height = E.screenrows - layout_root->y - INFOBAR_SIZE;
 
     computeNodeLayout(layout_root);
+
+    invalidateWindows();
 }
 
 void splitWindowLayout(bool split) /* TODO: check if there's enough space for the split */
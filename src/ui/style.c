@@ -0,0 +1,227 @@
+#include "style.h"
+
+#include "event.h"
+#include "term.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct StyleEntry
+{
+    Style style;
+    bool serialized;
+    uint8_t fglen, bglen, attrlen;
+    char fg[24];   /* ";38;5;188" */
+    char bg[24];
+    char attr[24]; /* ";1;4" */
+} StyleEntry;
+
+static StyleEntry *styles = NULL;
+static size_t nstyles = 0;
+static size_t styles_cap = 0;
+
+static StyleId *slots = NULL; /* Open addressing, id+1 or 0 when empty */
+static size_t nslots = 0;
+
+static ColorMode serialized_mode = COLOR_8;
+
+static const struct
+{
+    uint16_t attr;
+    const char *code;
+} ATTR_CODES[] = {
+    {ATTR_BOLD,      ";"ESC_BOLD},
+    {ATTR_DIM,       ";"ESC_DIM},
+    {ATTR_ITALIC,    ";"ESC_ITALIC},
+    {ATTR_UNDERLINE, ";"ESC_UNDERLINE},
+    {ATTR_BLINK,     ";"ESC_BLINKING},
+    {ATTR_INVERSE,   ";"ESC_INVERSE},
+};
+
+#define ATTR_CODES_NUM (sizeof(ATTR_CODES)/sizeof(ATTR_CODES[0]))
+
+static size_t styleHash(Style s)
+{
+    uint64_t h = ((uint64_t)s.fg << 32) ^ ((uint64_t)s.bg << 8) ^ s.attr;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+
+    return (size_t)h;
+}
+
+static bool styleEqual(Style a, Style b)
+{
+    return a.fg == b.fg && a.bg == b.bg && a.attr == b.attr;
+}
+
+static void styleRehash(size_t size)
+{
+    StyleId *new_slots = calloc(size, sizeof(StyleId));
+    if (!new_slots)
+    {
+        editorFatalError("Fatal! Memory error in the style table\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t id = 0; id < nstyles; id++)
+    {
+        size_t i = styleHash(styles[id].style) & (size - 1);
+        while (new_slots[i] != 0)
+        {
+            i = (i + 1) & (size - 1);
+        }
+        new_slots[i] = id + 1;
+    }
+
+    free(slots);
+    slots = new_slots;
+    nslots = size;
+}
+
+/* Return the id of the style, adding it to the table the first time */
+StyleId styleIntern(Style style)
+{
+    /* Most of the calls draw runs of cells with the same style */
+    static Style last_style;
+    static StyleId last_id;
+    static bool has_last = false;
+
+    if (has_last && styleEqual(style, last_style))
+        return last_id;
+
+    if (nslots == 0 || (nstyles + 1) * 2 > nslots)
+        styleRehash(nslots ? nslots * 2 : 64);
+
+    size_t i = styleHash(style) & (nslots - 1);
+    while (slots[i] != 0)
+    {
+        StyleId id = slots[i] - 1;
+        if (styleEqual(styles[id].style, style))
+        {
+            last_style = style;
+            last_id = id;
+            has_last = true;
+            return id;
+        }
+        i = (i + 1) & (nslots - 1);
+    }
+
+    if (nstyles == UINT16_MAX)
+        return 0; /* Full, it will look wrong but at least it works */
+
+    if (nstyles == styles_cap)
+    {
+        size_t new_cap = next_capacity(styles_cap, nstyles + 1);
+        StyleEntry *new_styles = realloc(styles, new_cap * sizeof(StyleEntry));
+        if (!new_styles)
+        {
+            editorFatalError("Fatal! Memory error in the style table\n");
+            exit(EXIT_FAILURE);
+        }
+        styles = new_styles;
+        styles_cap = new_cap;
+    }
+
+    StyleId id = nstyles++;
+    styles[id].style = style;
+    styles[id].serialized = false;
+    slots[i] = id + 1;
+
+    last_style = style;
+    last_id = id;
+    has_last = true;
+
+    return id;
+}
+
+/* The serialized parameters depend on the color mode, drop them when it
+ * changes */
+void styleSetColorMode(ColorMode mode)
+{
+    if (mode == serialized_mode)
+        return;
+
+    for (size_t id = 0; id < nstyles; id++)
+    {
+        styles[id].serialized = false;
+    }
+    serialized_mode = mode;
+}
+
+static StyleEntry *styleSerialized(StyleId id)
+{
+    StyleEntry *e = &styles[id];
+    if (e->serialized)
+        return e;
+
+    e->fglen = printFgColor(e->fg, sizeof(e->fg), serialized_mode, e->style.fg);
+    e->bglen = printBgColor(e->bg, sizeof(e->bg), serialized_mode, e->style.bg);
+
+    e->attrlen = 0;
+    for (size_t i = 0; i < ATTR_CODES_NUM; i++)
+    {
+        if (e->style.attr & ATTR_CODES[i].attr)
+            e->attrlen += snprintf(e->attr + e->attrlen, sizeof(e->attr) - e->attrlen, "%s", ATTR_CODES[i].code);
+    }
+
+    e->serialized = true;
+    return e;
+}
+
+static char *append(char *p, const char *s, size_t len)
+{
+    memcpy(p, s, len);
+    return p + len;
+}
+
+/* Write in buf (at least STYLE_SGR_MAX bytes) the SGR sequence that moves
+ * the terminal from style from to style to, and return its length. Only
+ * the parameters that change are sent, the attributes are reset only when
+ * some has to be turned off. With first set the current terminal style
+ * is unknown and everything is sent. */
+size_t styleTransition(char *buf, StyleId from, StyleId to, bool first)
+{
+    if (!first && from == to)
+        return 0;
+
+    StyleEntry *t = styleSerialized(to);
+    StyleEntry *f = first ? NULL : styleSerialized(from);
+
+    char params[STYLE_SGR_MAX];
+    char *p = params;
+
+    bool reset = first || (f->style.attr & ~t->style.attr);
+
+    if (reset)
+    {
+        p = append(p, ";"ESC_RESET_MODES, sizeof(";"ESC_RESET_MODES) - 1);
+        p = append(p, t->attr, t->attrlen);
+    }
+    else
+    {
+        for (size_t i = 0; i < ATTR_CODES_NUM; i++)
+        {
+            uint16_t a = ATTR_CODES[i].attr;
+            if ((t->style.attr & a) && !(f->style.attr & a))
+                p = append(p, ATTR_CODES[i].code, strlen(ATTR_CODES[i].code));
+        }
+    }
+
+    if (reset || f->style.fg != t->style.fg)
+        p = append(p, t->fg, t->fglen);
+    if (reset || f->style.bg != t->style.bg)
+        p = append(p, t->bg, t->bglen);
+
+    if (p == params)
+        return 0;
+
+    /* Drop the separator of the first parameter */
+    char *b = append(buf, "\x1b[", 2);
+    b = append(b, params + 1, p - params - 1);
+    b = append(b, "m", 1);
+
+    return b - buf;
+}
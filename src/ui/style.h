@@ -0,0 +1,21 @@
+#ifndef __EDITOR_STYLE_H
+#define __EDITOR_STYLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "color.h"
+
+/* Styles are interned: every distinct Style gets a small id, and its SGR
+ * parameters are serialized once for the color mode in use. */
+typedef uint16_t StyleId;
+
+#define STYLE_SGR_MAX 96 /* Longest sequence styleTransition() can produce */
+
+StyleId styleIntern(Style style);
+
+void styleSetColorMode(ColorMode mode);
+size_t styleTransition(char *buf, StyleId from, StyleId to, bool first);
+
+#endif /* __EDITOR_STYLE_H */
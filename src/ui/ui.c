@@ -55,7 +55,7 @@ static int computeCX()
     Window *W = E.active_win;
 
     int filerow = W->viewport.rowoff+W->cy;
-    Row *row = (filerow >= W->buf->numrows) ? NULL : &W->buf->rows[filerow];
+    Row *row = editorGetRow(W->buf, filerow);
     if (row)
     {
         for (int j = W->viewport.coloff; j < (W->cx+W->viewport.coloff); j++)
@@ -148,4 +148,6 @@ void editorTooSmallScreen(void)
     writen(STDOUT_FILENO, ab.b, ab.len);
     
     abFree(&ab);
+
+    fbInvalidate(E.fb);
 }
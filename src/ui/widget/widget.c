@@ -1,6 +1,7 @@
 #include "widget.h"
 
 #include "editor.h"
+#include "window.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -48,4 +49,6 @@ void deleteWidget(Widget *w)
     E.widgets[E.num_widget] = NULL;
 
     E.active_widget = NULL;
+
+    invalidateWindows();
 }
@@ -10,6 +10,7 @@
 #include "core.h"
 #include "syntax.h"
 #include "utf8.h"
+#include "term.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -31,6 +32,13 @@ static void windowInit(Window *W)
     W->viewport.right = 0;
     W->viewport.rowoff = 0;
     W->viewport.coloff = 0;
+
+    W->lines = NULL;
+    W->nlines = 0;
+    W->lines_valid = false;
+    W->drawn_rowoff = 0;
+
+    W->overlay = (Overlay){NULL, 0, 0};
 }
 
 Window *createWindow(void)
@@ -110,6 +118,7 @@ static void destroyWindow(Window *W)
 
     deleteWindowBuf(W);
 
+    free(W->lines);
     free(E.win[found_idx]);
 
     int remaining_elements = E.num_win - 1 - found_idx;
@@ -280,7 +289,13 @@ void resizeWindow(Window *W, float amount, bool direct)
 static void drawInfoBar(FrameBuffer *fb, Window *W)
 {
     char status[80], rstatus[80];
-    int len = snprintf(status, sizeof(status), 
+    int len;
+    int progress = editorLoadProgress(W->buf);
+    if (progress >= 0)
+        len = snprintf(status, sizeof(status),
+            "%.20s - %d lines (loading %d%%)", W->buf->filename, W->buf->numrows, progress);
+    else
+        len = snprintf(status, sizeof(status), 
             "%.20s - %d lines %s", W->buf->filename, W->buf->numrows, W->buf->dirty ? "(modified)" : "");
     int rlen = snprintf(rstatus, sizeof(rstatus),
             "%d/%d ", W->viewport.rowoff + W->cy + 1, W->buf->numrows);
@@ -402,8 +417,85 @@ static void drawLineNumber(FrameBuffer *fb, Window *W, int y, int width)
         fbWindowDrawChars(fb, W, 0, y, buf, blen, (Style){COLOR_BRIGHT_BLACK, COLOR_BLACK,0});
 }
 
+/* Something has been drawn over the windows, or they have been moved:
+ * every line has to be composed again */
+void invalidateWindows(void)
+{
+    for (size_t i = 0; i < E.num_win; i++)
+    {
+        E.win[i]->lines_valid = false;
+    }
+}
+
+/* The ranges are drawn by every frame until cleared, the text below them
+ * is left as it is */
+void windowSetOverlay(Window *W, const HighlightRange *ranges, size_t count, size_t current)
+{
+    W->overlay = (Overlay){ranges, count, current};
+    W->lines_valid = false;
+}
+
+void windowClearOverlay(Window *W)
+{
+    windowSetOverlay(W, NULL, 0, 0);
+}
+
+/* The first range of the overlay on row y or below it */
+static const HighlightRange *overlayFrom(const Overlay *o, int y)
+{
+    size_t lo = 0, hi = o->count;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (o->ranges[mid].y < y)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return o->ranges + lo;
+}
+
+/* Draw the ranges of the overlay on row r, shown at line y of the
+ * viewport, over its text. Returns the first range of the rows below. */
+static const HighlightRange *drawOverlay(FrameBuffer *fb, Window *W, Row *r, int filerow, int y,
+                                         const HighlightRange *range)
+{
+    const Overlay *o = &W->overlay;
+    const HighlightRange *end = o->ranges + o->count;
+    int indent = W->buf->indent_size;
+    int right = W->viewport.coloff + W->viewport.cols;
+    int cx = 0, rx = 0;
+
+    for (; range < end && range->y == filerow; range++)
+    {
+        size_t idx = range - o->ranges;
+        Style style = editorSyntaxToColor(idx == o->current ? HL_MATCH : HL_MATCH_OTHER);
+
+        /* Columns of the render follow the chars, tabs take more */
+        for (; cx < range->x + range->len && cx < r->size && rx < right; cx++)
+        {
+            int width = (r->chars[cx] == TAB) ? indent - rx % indent : 1;
+
+            for (int i = 0; cx >= range->x && i < width; i++)
+            {
+                int col = rx + i;
+                if (col >= W->viewport.coloff && col < right && (size_t)col < r->render.size)
+                    fbViewportPutChar(fb, W, col - W->viewport.coloff, y, r->render.c[col], style);
+            }
+
+            rx += width;
+        }
+    }
+
+    return range;
+}
+
 static void drawWelcomeScreen(FrameBuffer *fb, Window *W)
 {
+    W->lines_valid = false;
+
     for (int y = 0; y < W->viewport.rows; y++)
     {
         if (E.linenums)
@@ -436,27 +528,101 @@ static void drawWelcomeScreen(FrameBuffer *fb, Window *W)
     }
 }
 
+/* A full width window that scrolled by less than a screen moves its lines
+ * in the framebuffer (and on the terminal) instead of composing them
+ * again, only the exposed ones are left to draw. */
+static void scrollLineCache(FrameBuffer *fb, Window *W)
+{
+    int n = W->viewport.rowoff - W->drawn_rowoff;
+
+    if (n == 0 || abs(n) >= W->viewport.rows || W->x != 0 || W->width != fb->cols)
+        return;
+
+    int top = W->y + W->viewport.top;
+    if (!fbScrollRows(fb, top, top + W->viewport.rows - 1, n))
+        return;
+
+    int rows = W->viewport.rows - abs(n);
+    if (n > 0)
+        memmove(&W->lines[0], &W->lines[n], rows * sizeof(LineCache));
+    else
+        memmove(&W->lines[-n], &W->lines[0], rows * sizeof(LineCache));
+
+    int first = (n > 0) ? rows : 0;
+    for (int y = first; y < first + abs(n); y++)
+    {
+        W->lines[y].cols = -1; /* Never matches */
+    }
+}
+
 static void drawTextBuffer(FrameBuffer *fb, Window *W)
 {
     int lnum_width = getLineNumberWidth(W);
     W->viewport.left = (E.linenums ? lnum_width : 0); // TODO: hardcoded
 
-    for (int y = 0; y < W->viewport.rows; y++)
+    if (W->nlines != W->viewport.rows)
     {
-        int filerow = W->viewport.rowoff + y;
+        free(W->lines);
+        W->lines = malloc(W->viewport.rows * sizeof(LineCache));
+        W->nlines = W->lines ? W->viewport.rows : 0;
+        W->lines_valid = false;
+    }
+
+    /* Widgets are drawn over the windows */
+    bool use_cache = W->lines != NULL && W->lines_valid && E.num_widget == 0;
+
+    if (use_cache)
+        scrollLineCache(fb, W);
+    W->drawn_rowoff = W->viewport.rowoff;
+
+    /* Highlight the rows in view and the screen below them in one pass,
+     * so scrolling down finds them ready */
+    int ahead = W->viewport.rowoff + 2 * W->viewport.rows;
+    if (ahead >= W->buf->numrows)
+        ahead = W->buf->numrows - 1;
+    if (ahead >= 0)
+        editorHighlightRow(W->buf, editorGetRow(W->buf, ahead));
+
+    Row *r = editorGetRow(W->buf, W->viewport.rowoff);
+    const HighlightRange *range = overlayFrom(&W->overlay, W->viewport.rowoff);
 
+    for (int y = 0; y < W->viewport.rows; y++, r = editorRowNext(r))
+    {
         if (E.linenums)
             drawLineNumber(fb, W, y, lnum_width);
 
-        if (filerow >= W->buf->numrows)
+        if (r != NULL)
+            editorHighlightRow(W->buf, r);
+
+        if (W->lines != NULL)
+        {
+            LineCache line = {
+                .row = r,
+                .gen = r ? r->gen : 0,
+                .coloff = W->viewport.coloff,
+                .left = W->viewport.left,
+                .cols = W->viewport.cols,
+                .cursor_line = (E.active_win == W && y == W->cy)
+            };
+
+            LineCache *cached = &W->lines[y];
+            if (use_cache && cached->row == line.row && cached->gen == line.gen &&
+                cached->coloff == line.coloff && cached->left == line.left &&
+                cached->cols == line.cols && cached->cursor_line == line.cursor_line)
+            {
+                continue;
+            }
+
+            *cached = line;
+        }
+
+        if (r == NULL)
         {
             fbViewportPutChar(fb, W, 0, y, '~', STYLE_NORMAL);
             fbViewportEraseLineFrom(fb, W, y, 1, COLOR_DEFAULT_BG);
             continue;
         }
 
-        Row *r = &W->buf->rows[filerow];
-
         int len = r->render.size - W->viewport.coloff;
 
         if (len > W->viewport.cols)
@@ -486,8 +652,15 @@ static void drawTextBuffer(FrameBuffer *fb, Window *W)
         {
             fbViewportEraseLineFrom(fb, W, y, len, COLOR_DEFAULT_BG);
         }
+
+        int filerow = W->viewport.rowoff + y;
+        while (range < W->overlay.ranges + W->overlay.count && range->y < filerow)
+            range++;
+        range = drawOverlay(fb, W, r, filerow, y, range);
     }
 
+    W->lines_valid = (W->lines != NULL);
+
     // for (int y = 0; y < w->height; y++)
     // {
     //     int fbY = w->y + y;
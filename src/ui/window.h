@@ -2,6 +2,7 @@
 #define __EDITOR_WINDOW_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "layout.h"
 
@@ -16,6 +17,33 @@ typedef struct Viewport
 
 typedef struct TextBuffer TextBuffer;
 typedef struct FrameBuffer FrameBuffer;
+typedef struct Row Row;
+
+/* What has been composed on a viewport line by the last frame */
+typedef struct LineCache
+{
+    Row *row;
+    unsigned int gen;
+    int coloff;
+    int left, cols;
+    bool cursor_line;
+} LineCache;
+
+/* Chars x..x+len of row y, drawn over the syntax highlight */
+typedef struct HighlightRange
+{
+    int x, y;
+    int len;
+} HighlightRange;
+
+/* Ranges drawn over the text of a window, like the matches of a search.
+ * They are not copied: whoever sets them keeps them alive until cleared. */
+typedef struct Overlay
+{
+    const HighlightRange *ranges;  /* Sorted by row, then by column */
+    size_t count;
+    size_t current;  /* Drawn as HL_MATCH, the others as HL_MATCH_OTHER */
+} Overlay;
 
 #define WINDOW_MAX_TAB 10
 
@@ -39,6 +67,11 @@ typedef struct Window
     int width, height;
     int cx, cy; /* cursor x, y*/
     int expected_cx;
+    LineCache *lines; /* One for each viewport row */
+    int nlines;
+    bool lines_valid; /* The framebuffer still holds what lines describe */
+    int drawn_rowoff; /* viewport.rowoff of the last frame */
+    Overlay overlay;
 } Window;
 
 Window *createWindow(void);
@@ -51,6 +84,9 @@ void switchWindow(Direction dir);
 void resizeWindow(Window *W, float amount, bool directed);
 
 int getLineNumberWidth(Window *W);
+void invalidateWindows(void);
+void windowSetOverlay(Window *W, const HighlightRange *ranges, size_t count, size_t current);
+void windowClearOverlay(Window *W);
 void drawWindow(FrameBuffer *fb, Window *W);
 
 #endif /* __EDITOR_WINDOW_H */
@@ -0,0 +1,167 @@
+#include "linescan.h"
+
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define LINESCAN_X86
+#include <immintrin.h>
+#endif
+
+typedef struct OffsetVector
+{
+    size_t *data;
+    size_t size;
+    size_t capacity;
+} OffsetVector;
+
+typedef int (*scan_fn)(const char *s, size_t len, OffsetVector *v);
+
+static int offsets_push(OffsetVector *v, size_t offset)
+{
+    if (v->size == v->capacity)
+    {
+        size_t new_capacity = next_capacity(v->capacity, v->size + 1);
+        size_t *new_data = realloc(v->data, new_capacity * sizeof(size_t));
+        if (!new_data)
+            return -1;
+
+        v->data = new_data;
+        v->capacity = new_capacity;
+    }
+
+    v->data[v->size++] = offset;
+    return 0;
+}
+
+static int scan_tail(const char *s, size_t from, size_t len, OffsetVector *v)
+{
+    const char *p = s + from;
+    const char *end = s + len;
+
+    while ((p = memchr(p, '\n', end - p)) != NULL)
+    {
+        if (offsets_push(v, p - s) == -1)
+            return -1;
+        p++;
+    }
+
+    return 0;
+}
+
+static int scan_scalar(const char *s, size_t len, OffsetVector *v)
+{
+    return scan_tail(s, 0, len, v);
+}
+
+#ifdef LINESCAN_X86
+
+__attribute__((target("sse2")))
+static int scan_sse2(const char *s, size_t len, OffsetVector *v)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(s + i));
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, nl));
+
+        while (mask)
+        {
+            if (offsets_push(v, i + __builtin_ctz(mask)) == -1)
+                return -1;
+            mask &= mask - 1;
+        }
+    }
+
+    return scan_tail(s, i, len, v);
+}
+
+__attribute__((target("avx2")))
+static int scan_avx2(const char *s, size_t len, OffsetVector *v)
+{
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(s + i));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, nl));
+
+        while (mask)
+        {
+            if (offsets_push(v, i + __builtin_ctz(mask)) == -1)
+                return -1;
+            mask &= mask - 1;
+        }
+    }
+
+    return scan_tail(s, i, len, v);
+}
+
+#endif /* LINESCAN_X86 */
+
+/* Picked once, the loader thread and the main one can both get here first */
+static scan_fn scan_impl = NULL;
+static const char *scan_impl_name = NULL;
+static pthread_once_t scan_once = PTHREAD_ONCE_INIT;
+
+static void scan_resolve(void)
+{
+    scan_impl = scan_scalar;
+    scan_impl_name = "scalar";
+
+#ifdef LINESCAN_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        scan_impl = scan_avx2;
+        scan_impl_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        scan_impl = scan_sse2;
+        scan_impl_name = "sse2";
+    }
+#endif
+}
+
+/**
+ * Finds every '\n' in the first 'len' bytes of 's' in a single pass and
+ * stores their offsets in '*newlines' (to be freed by the caller).
+ * Returns the number of newlines found, or (size_t)-1 on memory failure.
+ */
+size_t scan_newlines(const char *s, size_t len, size_t **newlines)
+{
+    pthread_once(&scan_once, scan_resolve);
+
+    /* Guess an average line length to avoid most of the reallocations */
+    OffsetVector v = {NULL, 0, 0};
+    v.capacity = len / 32 + 16;
+    v.data = malloc(v.capacity * sizeof(size_t));
+    if (!v.data)
+        return (size_t)-1;
+
+    if (scan_impl(s, len, &v) == -1)
+    {
+        free(v.data);
+        return (size_t)-1;
+    }
+
+    *newlines = v.data;
+    return v.size;
+}
+
+/* Name of the implementation picked for this CPU */
+const char *scan_newlines_impl(void)
+{
+    pthread_once(&scan_once, scan_resolve);
+
+    return scan_impl_name;
+}
@@ -0,0 +1,9 @@
+#ifndef __EDITOR_LINESCAN_H
+#define __EDITOR_LINESCAN_H
+
+#include <stddef.h>
+
+size_t scan_newlines(const char *s, size_t len, size_t **newlines);
+const char *scan_newlines_impl(void);
+
+#endif /* __EDITOR_LINESCAN_H */
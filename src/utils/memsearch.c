@@ -0,0 +1,238 @@
+#include "memsearch.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MEMSEARCH_X86
+#include <immintrin.h>
+#endif
+
+/* The vector versions compare a block of positions at once against the
+ * first and the last byte of the needle, and check the whole needle only
+ * where both are there. Text rarely has both at the right distance, so
+ * most blocks are skipped with a couple of compares. */
+
+typedef const char *(*search_fn)(const char *hay, size_t n, const char *needle, size_t m);
+
+static int matches_at(const char *p, const char *needle, size_t m)
+{
+    return memcmp(p + 1, needle + 1, m - 1) == 0;
+}
+
+/* The needle fits at the positions below end: look in [from, end) */
+static const char *find_tail(const char *hay, size_t from, size_t end, const char *needle, size_t m)
+{
+    const char *p = hay + from;
+    const char *stop = hay + end;
+
+    while (p < stop && (p = memchr(p, needle[0], stop - p)) != NULL)
+    {
+        if (matches_at(p, needle, m))
+            return p;
+        p++;
+    }
+
+    return NULL;
+}
+
+/* The same backward, in [0, end) */
+static const char *rfind_tail(const char *hay, size_t end, const char *needle, size_t m)
+{
+    for (size_t i = end; i-- > 0;)
+    {
+        if (hay[i] == needle[0] && matches_at(hay + i, needle, m))
+            return hay + i;
+    }
+
+    return NULL;
+}
+
+static const char *find_scalar(const char *hay, size_t n, const char *needle, size_t m)
+{
+    return find_tail(hay, 0, n - m + 1, needle, m);
+}
+
+static const char *rfind_scalar(const char *hay, size_t n, const char *needle, size_t m)
+{
+    return rfind_tail(hay, n - m + 1, needle, m);
+}
+
+#ifdef MEMSEARCH_X86
+
+__attribute__((target("sse2")))
+static unsigned int candidates_sse2(const char *p, size_t m, __m128i first, __m128i last)
+{
+    __m128i a = _mm_loadu_si128((const __m128i *)p);
+    __m128i b = _mm_loadu_si128((const __m128i *)(p + m - 1));
+
+    return _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+}
+
+__attribute__((target("sse2")))
+static const char *find_sse2(const char *hay, size_t n, const char *needle, size_t m)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[m - 1]);
+    size_t end = n - m + 1;
+    size_t i = 0;
+
+    for (; i + 16 <= end; i += 16)
+    {
+        unsigned int mask = candidates_sse2(hay + i, m, first, last);
+
+        while (mask)
+        {
+            const char *p = hay + i + __builtin_ctz(mask);
+            if (matches_at(p, needle, m))
+                return p;
+            mask &= mask - 1;
+        }
+    }
+
+    return find_tail(hay, i, end, needle, m);
+}
+
+__attribute__((target("sse2")))
+static const char *rfind_sse2(const char *hay, size_t n, const char *needle, size_t m)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[m - 1]);
+    size_t end = n - m + 1;
+
+    for (; end >= 16; end -= 16)
+    {
+        unsigned int mask = candidates_sse2(hay + end - 16, m, first, last);
+
+        while (mask)
+        {
+            int bit = 31 - __builtin_clz(mask);
+            const char *p = hay + end - 16 + bit;
+            if (matches_at(p, needle, m))
+                return p;
+            mask &= ~(1u << bit);
+        }
+    }
+
+    return rfind_tail(hay, end, needle, m);
+}
+
+__attribute__((target("avx2")))
+static uint32_t candidates_avx2(const char *p, size_t m, __m256i first, __m256i last)
+{
+    __m256i a = _mm256_loadu_si256((const __m256i *)p);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(p + m - 1));
+
+    return (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+}
+
+__attribute__((target("avx2")))
+static const char *find_avx2(const char *hay, size_t n, const char *needle, size_t m)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+    size_t end = n - m + 1;
+    size_t i = 0;
+
+    for (; i + 32 <= end; i += 32)
+    {
+        uint32_t mask = candidates_avx2(hay + i, m, first, last);
+
+        while (mask)
+        {
+            const char *p = hay + i + __builtin_ctz(mask);
+            if (matches_at(p, needle, m))
+                return p;
+            mask &= mask - 1;
+        }
+    }
+
+    return find_tail(hay, i, end, needle, m);
+}
+
+__attribute__((target("avx2")))
+static const char *rfind_avx2(const char *hay, size_t n, const char *needle, size_t m)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+    size_t end = n - m + 1;
+
+    for (; end >= 32; end -= 32)
+    {
+        uint32_t mask = candidates_avx2(hay + end - 32, m, first, last);
+
+        while (mask)
+        {
+            int bit = 31 - __builtin_clz(mask);
+            const char *p = hay + end - 32 + bit;
+            if (matches_at(p, needle, m))
+                return p;
+            mask &= ~(1u << bit);
+        }
+    }
+
+    return rfind_tail(hay, end, needle, m);
+}
+
+#endif /* MEMSEARCH_X86 */
+
+/* Picked once, the first search can come from several workers at once */
+static search_fn find_impl = NULL;
+static search_fn rfind_impl = NULL;
+static pthread_once_t search_once = PTHREAD_ONCE_INIT;
+
+static void search_resolve(void)
+{
+    find_impl = find_scalar;
+    rfind_impl = rfind_scalar;
+
+#ifdef MEMSEARCH_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        find_impl = find_avx2;
+        rfind_impl = rfind_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        find_impl = find_sse2;
+        rfind_impl = rfind_sse2;
+    }
+#endif
+}
+
+/**
+ * Returns the first occurrence of the 'm' bytes of 'needle' inside the
+ * first 'n' bytes of 'hay', or NULL. Neither has to be null terminated.
+ */
+const char *mem_find(const char *hay, size_t n, const char *needle, size_t m)
+{
+    if (m == 0)
+        return hay;
+    if (m > n)
+        return NULL;
+    if (m == 1)
+        return memchr(hay, needle[0], n);
+
+    pthread_once(&search_once, search_resolve);
+
+    return find_impl(hay, n, needle, m);
+}
+
+/**
+ * Same as mem_find(), but returns the last occurrence. The text is
+ * scanned from the end, so the ones before are never looked at.
+ */
+const char *mem_rfind(const char *hay, size_t n, const char *needle, size_t m)
+{
+    if (m == 0)
+        return hay + n;
+    if (m > n)
+        return NULL;
+
+    pthread_once(&search_once, search_resolve);
+
+    return rfind_impl(hay, n, needle, m);
+}
@@ -0,0 +1,9 @@
+#ifndef __EDITOR_MEMSEARCH_H
+#define __EDITOR_MEMSEARCH_H
+
+#include <stddef.h>
+
+const char *mem_find(const char *hay, size_t n, const char *needle, size_t m);
+const char *mem_rfind(const char *hay, size_t n, const char *needle, size_t m);
+
+#endif /* __EDITOR_MEMSEARCH_H */
@@ -0,0 +1,1276 @@
+#include "regexp.h"
+
+#include "memsearch.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+/* A pattern is parsed into a tree, then compiled into two Thompson NFAs:
+ * one reading the text forward, one reading it backward. The NFAs are
+ * never simulated directly: the states of the equivalent DFAs (sets of NFA
+ * states) are built the first time a transition needs them and cached, so
+ * most bytes cost one table lookup and none costs more than one step of
+ * every NFA state. There is no backtracking, and no pattern can make a
+ * search slower than linear.
+ *
+ * A search runs the forward DFA, with a new thread starting at every
+ * byte, up to the end of the leftmost-longest match; then the backward
+ * DFA, from that end, finds where the match starts. */
+
+#define REGEXP_MAX_STATES 8192    /* NFA states, counted repetitions make many */
+#define REGEXP_MAX_REPEAT 1000
+#define REGEXP_CACHE_STATES 1024  /* DFA states kept before the cache is flushed */
+#define REGEXP_MAX_PREFIX 64
+
+typedef uint8_t ByteSet[32];
+
+static bool set_has(const ByteSet set, unsigned char c)
+{
+    return set[c >> 3] & (1 << (c & 7));
+}
+
+static void set_add(ByteSet set, unsigned char c)
+{
+    set[c >> 3] |= 1 << (c & 7);
+}
+
+static void set_add_range(ByteSet set, int lo, int hi)
+{
+    for (int c = lo; c <= hi; c++)
+        set_add(set, c);
+}
+
+/* The byte of a set with a single one, or -1 */
+static int set_single(const ByteSet set)
+{
+    int found = -1;
+
+    for (int c = 0; c < 256; c++)
+    {
+        if (!set_has(set, c))
+            continue;
+        if (found >= 0)
+            return -1;
+        found = c;
+    }
+
+    return found;
+}
+
+/* Parsing */
+
+typedef enum NodeType
+{
+    NODE_EMPTY,
+    NODE_SET,
+    NODE_CAT,
+    NODE_ALT,
+    NODE_REPEAT,
+    NODE_BOL,
+    NODE_EOL
+} NodeType;
+
+typedef struct Node
+{
+    NodeType type;
+    int a, b;      /* Children, as indexes in the parser nodes */
+    int min, max;  /* Repetition bounds, max is -1 if unbounded */
+    ByteSet set;
+} Node;
+
+typedef struct Parser
+{
+    const char *p;
+    const char *error;
+    Node *nodes;
+    size_t num_nodes;
+    size_t capacity;
+} Parser;
+
+static int parse_alt(Parser *ps);
+
+static int new_node(Parser *ps, NodeType type, int a, int b)
+{
+    if (ps->num_nodes == ps->capacity)
+    {
+        size_t new_capacity = next_capacity(ps->capacity, ps->num_nodes + 1);
+        Node *new_nodes = realloc(ps->nodes, new_capacity * sizeof(Node));
+        if (!new_nodes)
+        {
+            ps->error = "out of memory";
+            return -1;
+        }
+
+        ps->nodes = new_nodes;
+        ps->capacity = new_capacity;
+    }
+
+    Node *n = &ps->nodes[ps->num_nodes];
+    memset(n, 0, sizeof(Node));
+    n->type = type;
+    n->a = a;
+    n->b = b;
+
+    return ps->num_nodes++;
+}
+
+static int set_node(Parser *ps, const ByteSet set)
+{
+    int n = new_node(ps, NODE_SET, -1, -1);
+    if (n >= 0)
+        memcpy(ps->nodes[n].set, set, sizeof(ByteSet));
+
+    return n;
+}
+
+/* The escape after a '\', in or out of classes */
+static int parse_escape(Parser *ps, ByteSet set)
+{
+    unsigned char c = *ps->p;
+    if (c == '\0')
+    {
+        ps->error = "trailing \\";
+        return -1;
+    }
+    ps->p++;
+
+    switch (c)
+    {
+    case 'd':
+    case 'D':
+        set_add_range(set, '0', '9');
+        break;
+    case 'w':
+    case 'W':
+        set_add_range(set, 'a', 'z');
+        set_add_range(set, 'A', 'Z');
+        set_add_range(set, '0', '9');
+        set_add(set, '_');
+        break;
+    case 's':
+    case 'S':
+        set_add(set, ' ');
+        set_add_range(set, '\t', '\r');
+        break;
+    case 't':
+        set_add(set, '\t');
+        return 0;
+    case 'n':
+        set_add(set, '\n');
+        return 0;
+    case 'r':
+        set_add(set, '\r');
+        return 0;
+    default:
+        if (isalnum(c))
+        {
+            ps->error = "unsupported escape";
+            return -1;
+        }
+        set_add(set, c);
+        return 0;
+    }
+
+    if (isupper(c))
+    {
+        for (size_t i = 0; i < sizeof(ByteSet); i++)
+            set[i] = ~set[i];
+    }
+
+    return 0;
+}
+
+static int parse_class(Parser *ps)
+{
+    ByteSet set = {0};
+    bool negate = false;
+
+    if (*ps->p == '^')
+    {
+        negate = true;
+        ps->p++;
+    }
+
+    /* A ']' right after the '[' is a plain character */
+    for (bool first = true; first || *ps->p != ']'; first = false)
+    {
+        if (*ps->p == '\0')
+        {
+            ps->error = "missing ]";
+            return -1;
+        }
+
+        ByteSet item = {0};
+        int lo;
+
+        if (*ps->p == '\\')
+        {
+            ps->p++;
+            if (parse_escape(ps, item) < 0)
+                return -1;
+
+            lo = set_single(item);
+            if (lo < 0)
+            {
+                /* \d and friends can't start a range */
+                for (size_t i = 0; i < sizeof(ByteSet); i++)
+                    set[i] |= item[i];
+                continue;
+            }
+        }
+        else
+        {
+            lo = (unsigned char)*ps->p++;
+        }
+
+        int hi = lo;
+        if (ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0')
+        {
+            ps->p++;
+            if (*ps->p == '\\')
+            {
+                ByteSet end = {0};
+                ps->p++;
+                if (parse_escape(ps, end) < 0)
+                    return -1;
+                hi = set_single(end);
+            }
+            else
+            {
+                hi = (unsigned char)*ps->p++;
+            }
+
+            if (hi < lo)
+            {
+                ps->error = "bad range";
+                return -1;
+            }
+        }
+
+        set_add_range(set, lo, hi);
+    }
+    ps->p++;
+
+    if (negate)
+    {
+        for (size_t i = 0; i < sizeof(ByteSet); i++)
+            set[i] = ~set[i];
+    }
+
+    return set_node(ps, set);
+}
+
+static int parse_atom(Parser *ps)
+{
+    unsigned char c = *ps->p++;
+    ByteSet set = {0};
+
+    switch (c)
+    {
+    case '(':
+    {
+        int n = parse_alt(ps);
+        if (n < 0)
+            return -1;
+        if (*ps->p != ')')
+        {
+            ps->error = "missing )";
+            return -1;
+        }
+        ps->p++;
+        return n;
+    }
+    case '[':
+        return parse_class(ps);
+    case '.':
+        memset(set, 0xff, sizeof(ByteSet));
+        return set_node(ps, set);
+    case '^':
+        return new_node(ps, NODE_BOL, -1, -1);
+    case '$':
+        return new_node(ps, NODE_EOL, -1, -1);
+    case '*':
+    case '+':
+    case '?':
+        ps->error = "nothing to repeat";
+        return -1;
+    case '\\':
+        if (parse_escape(ps, set) < 0)
+            return -1;
+        return set_node(ps, set);
+    default:
+        set_add(set, c);
+        return set_node(ps, set);
+    }
+}
+
+/* Read {m}, {m,} or {m,n}. Anything else is not a repetition, and the
+ * '{' is taken as a plain character. */
+static bool parse_bounds(Parser *ps, int *min, int *max)
+{
+    const char *p = ps->p + 1;
+    char *end;
+
+    if (!isdigit((unsigned char)*p))
+        return false;
+    long lo = strtol(p, &end, 10);
+    long hi = lo;
+    p = end;
+
+    if (*p == ',')
+    {
+        p++;
+        hi = -1;
+        if (isdigit((unsigned char)*p))
+        {
+            hi = strtol(p, &end, 10);
+            p = end;
+        }
+    }
+
+    if (*p != '}')
+        return false;
+
+    ps->p = p + 1;
+    *min = lo > REGEXP_MAX_REPEAT ? REGEXP_MAX_REPEAT + 1 : lo;
+    *max = hi > REGEXP_MAX_REPEAT ? REGEXP_MAX_REPEAT + 1 : hi;
+    return true;
+}
+
+static int parse_repeat(Parser *ps)
+{
+    int n = parse_atom(ps);
+
+    while (n >= 0)
+    {
+        int min, max;
+
+        switch (*ps->p)
+        {
+        case '*':
+            min = 0, max = -1;
+            ps->p++;
+            break;
+        case '+':
+            min = 1, max = -1;
+            ps->p++;
+            break;
+        case '?':
+            min = 0, max = 1;
+            ps->p++;
+            break;
+        case '{':
+            if (!parse_bounds(ps, &min, &max))
+                return n;
+            if (min > REGEXP_MAX_REPEAT || max > REGEXP_MAX_REPEAT || (max >= 0 && max < min))
+            {
+                ps->error = "bad repetition";
+                return -1;
+            }
+            break;
+        default:
+            return n;
+        }
+
+        n = new_node(ps, NODE_REPEAT, n, -1);
+        if (n >= 0)
+        {
+            ps->nodes[n].min = min;
+            ps->nodes[n].max = max;
+        }
+    }
+
+    return n;
+}
+
+static int parse_cat(Parser *ps)
+{
+    int n = new_node(ps, NODE_EMPTY, -1, -1);
+
+    while (n >= 0 && *ps->p != '\0' && *ps->p != '|' && *ps->p != ')')
+    {
+        int next = parse_repeat(ps);
+        if (next < 0)
+            return -1;
+        n = new_node(ps, NODE_CAT, n, next);
+    }
+
+    return n;
+}
+
+static int parse_alt(Parser *ps)
+{
+    int n = parse_cat(ps);
+
+    while (n >= 0 && *ps->p == '|')
+    {
+        ps->p++;
+        int next = parse_cat(ps);
+        if (next < 0)
+            return -1;
+        n = new_node(ps, NODE_ALT, n, next);
+    }
+
+    return n;
+}
+
+/* Append to prefix the text every match of the node starts with. Returns
+ * false when what follows the node can't be part of the prefix. */
+static bool literal_prefix(const Parser *ps, int node, char *prefix, size_t *len)
+{
+    const Node *n = &ps->nodes[node];
+    int c;
+
+    switch (n->type)
+    {
+    case NODE_EMPTY:
+    case NODE_BOL:
+        return true;
+    case NODE_SET:
+        c = set_single(n->set);
+        if (c < 0 || *len == REGEXP_MAX_PREFIX)
+            return false;
+        prefix[(*len)++] = c;
+        return true;
+    case NODE_CAT:
+        return literal_prefix(ps, n->a, prefix, len) && literal_prefix(ps, n->b, prefix, len);
+    case NODE_REPEAT:
+        if (n->min > 0)
+            literal_prefix(ps, n->a, prefix, len);
+        return false;
+    default:
+        return false;
+    }
+}
+
+/* NFAs */
+
+typedef enum NFAType
+{
+    NFA_SET,
+    NFA_SPLIT,
+    NFA_BOL,   /* Only at the start of the text */
+    NFA_EOL,   /* Only at the end of the text */
+    NFA_MATCH
+} NFAType;
+
+typedef struct NFAState
+{
+    NFAType type;
+    int out, out1;
+    ByteSet set;
+} NFAState;
+
+typedef struct NFA
+{
+    NFAState *states;
+    int num_states;
+    int capacity;
+    int start;
+} NFA;
+
+static int nfa_add(NFA *nfa, NFAType type, int out, int out1, const char **error)
+{
+    if (nfa->num_states == REGEXP_MAX_STATES)
+    {
+        *error = "pattern too large";
+        return -1;
+    }
+
+    if (nfa->num_states == nfa->capacity)
+    {
+        int new_capacity = next_capacity(nfa->capacity, nfa->num_states + 1);
+        NFAState *new_states = realloc(nfa->states, new_capacity * sizeof(NFAState));
+        if (!new_states)
+        {
+            *error = "out of memory";
+            return -1;
+        }
+
+        nfa->states = new_states;
+        nfa->capacity = new_capacity;
+    }
+
+    NFAState *s = &nfa->states[nfa->num_states];
+    memset(s, 0, sizeof(NFAState));
+    s->type = type;
+    s->out = out;
+    s->out1 = out1;
+
+    return nfa->num_states++;
+}
+
+/* Compile the node so that it goes on to out, and return where it starts.
+ * Backward, concatenations are reversed and the anchors swapped. */
+static int compile_node(const Parser *ps, NFA *nfa, int node, int out, bool reverse, const char **error)
+{
+    const Node *n = &ps->nodes[node];
+    int s, a, b;
+
+    if (out < 0)
+        return -1;
+
+    switch (n->type)
+    {
+    case NODE_EMPTY:
+        return out;
+    case NODE_SET:
+        s = nfa_add(nfa, NFA_SET, out, -1, error);
+        if (s >= 0)
+            memcpy(nfa->states[s].set, n->set, sizeof(ByteSet));
+        return s;
+    case NODE_BOL:
+        return nfa_add(nfa, reverse ? NFA_EOL : NFA_BOL, out, -1, error);
+    case NODE_EOL:
+        return nfa_add(nfa, reverse ? NFA_BOL : NFA_EOL, out, -1, error);
+    case NODE_CAT:
+        if (reverse)
+            return compile_node(ps, nfa, n->b, compile_node(ps, nfa, n->a, out, reverse, error), reverse, error);
+        return compile_node(ps, nfa, n->a, compile_node(ps, nfa, n->b, out, reverse, error), reverse, error);
+    case NODE_ALT:
+        a = compile_node(ps, nfa, n->a, out, reverse, error);
+        b = compile_node(ps, nfa, n->b, out, reverse, error);
+        if (a < 0 || b < 0)
+            return -1;
+        return nfa_add(nfa, NFA_SPLIT, a, b, error);
+    case NODE_REPEAT:
+    {
+        int tail = out;
+
+        if (n->max < 0)
+        {
+            int loop = nfa_add(nfa, NFA_SPLIT, -1, out, error);
+            if (loop < 0)
+                return -1;
+            int body = compile_node(ps, nfa, n->a, loop, reverse, error);
+            if (body < 0)
+                return -1;
+            nfa->states[loop].out = body;
+            tail = loop;
+        }
+        else
+        {
+            for (int i = n->min; i < n->max; i++)
+            {
+                int body = compile_node(ps, nfa, n->a, tail, reverse, error);
+                if (body < 0)
+                    return -1;
+                tail = nfa_add(nfa, NFA_SPLIT, body, out, error);
+                if (tail < 0)
+                    return -1;
+            }
+        }
+
+        for (int i = 0; i < n->min; i++)
+        {
+            tail = compile_node(ps, nfa, n->a, tail, reverse, error);
+            if (tail < 0)
+                return -1;
+        }
+
+        return tail;
+    }
+    }
+
+    return -1;
+}
+
+/* Lazy DFAs */
+
+#define DFA_UNKNOWN -1  /* Transition not built yet */
+#define DFA_MARK -1     /* Splits the groups of NFA states of a DFA state */
+
+typedef struct DFAState
+{
+    int *items;      /* NFA states, sorted, in groups split by DFA_MARK */
+    int len;
+    unsigned int hash;
+    bool match;      /* A match ends right here */
+    bool eol_match;  /* The same, if the text ends here */
+    bool matched;    /* Leftmost DFAs: a match was found, no new one may start */
+    bool dead;       /* No match can end from here on */
+    bool start;      /* Nothing in progress, skip to the next prefix */
+} DFAState;
+
+typedef struct DFA
+{
+    const NFA *nfa;
+    const Regexp *re;
+    bool unanchored;  /* A match may start at every position */
+    bool leftmost;    /* Only the match starting first matters */
+
+    DFAState *states;
+    int num_states;
+    int *trans;       /* [state * num_classes + class] */
+    uint8_t *quiet;   /* [state]: nothing to check there, the scan goes on */
+    int *buckets;     /* Hash table of the states */
+    int starts[2];    /* Start states, in the middle of the text and at its start */
+    unsigned int flushes;
+
+    /* Scratch space for the steps */
+    int *list;
+    int *stack;
+    unsigned int *seen;
+    unsigned int gen;
+} DFA;
+
+#define DFA_BUCKETS (REGEXP_CACHE_STATES * 2)
+
+struct Regexp
+{
+    NFA forward;
+    NFA backward;
+    uint8_t classes[256];  /* Bytes that no NFA state tells apart share a class */
+    uint8_t reps[256];     /* A byte of every class */
+    int num_classes;
+
+    char prefix[REGEXP_MAX_PREFIX];
+    size_t prefix_len;
+    bool empty_match;  /* Matches an empty text, where '^' and '$' both hold */
+
+    DFA search;       /* Forward, unanchored: end of the first match */
+    DFA search_start; /* Backward from there: its start */
+    DFA last;         /* Backward, unanchored: start of the last match */
+    DFA last_end;     /* Forward from there: its end */
+};
+
+static int dfa_init(DFA *d, const NFA *nfa, const Regexp *re, bool unanchored, bool leftmost)
+{
+    memset(d, 0, sizeof(DFA));
+    d->nfa = nfa;
+    d->re = re;
+    d->unanchored = unanchored;
+    d->leftmost = leftmost;
+    d->starts[0] = d->starts[1] = -1;
+
+    d->states = malloc(REGEXP_CACHE_STATES * sizeof(DFAState));
+    d->trans = malloc((size_t)REGEXP_CACHE_STATES * re->num_classes * sizeof(int));
+    d->quiet = malloc(REGEXP_CACHE_STATES);
+    d->buckets = malloc(DFA_BUCKETS * sizeof(int));
+    d->list = malloc((2 * nfa->num_states + 2) * sizeof(int));
+    d->stack = malloc(nfa->num_states * sizeof(int));
+    d->seen = calloc(nfa->num_states, sizeof(unsigned int));
+
+    if (!d->states || !d->trans || !d->quiet || !d->buckets || !d->list || !d->stack || !d->seen)
+        return -1;
+
+    memset(d->buckets, -1, DFA_BUCKETS * sizeof(int));
+    return 0;
+}
+
+static void dfa_flush(DFA *d)
+{
+    for (int i = 0; i < d->num_states; i++)
+        free(d->states[i].items);
+
+    d->num_states = 0;
+    d->starts[0] = d->starts[1] = -1;
+    d->flushes++;
+    memset(d->buckets, -1, DFA_BUCKETS * sizeof(int));
+}
+
+static void dfa_free(DFA *d)
+{
+    if (d->states)
+        dfa_flush(d);
+
+    free(d->states);
+    free(d->trans);
+    free(d->quiet);
+    free(d->buckets);
+    free(d->list);
+    free(d->stack);
+    free(d->seen);
+}
+
+/* Append to the list the NFA states reachable from state without reading
+ * a byte. States already in the list (from a match that started earlier)
+ * are skipped. */
+static void dfa_closure(DFA *d, int state, bool bol, int *len)
+{
+    const NFAState *states = d->nfa->states;
+    int top = 0;
+
+    if (d->seen[state] == d->gen)
+        return;
+    d->seen[state] = d->gen;
+    d->stack[top++] = state;
+
+    while (top > 0)
+    {
+        int s = d->stack[--top];
+        int next[2] = {-1, -1};
+
+        switch (states[s].type)
+        {
+        case NFA_SET:
+        case NFA_EOL:
+        case NFA_MATCH:
+            d->list[(*len)++] = s;
+            break;
+        case NFA_BOL:
+            if (bol)
+                next[0] = states[s].out;
+            break;
+        case NFA_SPLIT:
+            next[0] = states[s].out;
+            next[1] = states[s].out1;
+            break;
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (next[i] >= 0 && d->seen[next[i]] != d->gen)
+            {
+                d->seen[next[i]] = d->gen;
+                d->stack[top++] = next[i];
+            }
+        }
+    }
+}
+
+/* Tell if a match is reached from state when the text ends there (and
+ * starts there too, with bol) */
+static bool dfa_matches_at_end(DFA *d, int state, bool bol)
+{
+    const NFAState *states = d->nfa->states;
+    int top = 0;
+
+    d->gen++;
+    d->seen[state] = d->gen;
+    d->stack[top++] = state;
+
+    while (top > 0)
+    {
+        const NFAState *s = &states[d->stack[--top]];
+        int next[2] = {-1, -1};
+
+        if (s->type == NFA_MATCH)
+            return true;
+        if (s->type == NFA_EOL || (s->type == NFA_BOL && bol))
+            next[0] = s->out;
+        if (s->type == NFA_SPLIT)
+            next[0] = s->out, next[1] = s->out1;
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (next[i] >= 0 && d->seen[next[i]] != d->gen)
+            {
+                d->seen[next[i]] = d->gen;
+                d->stack[top++] = next[i];
+            }
+        }
+    }
+
+    return false;
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/* Turn the list into a DFA state, reusing the cached one if there is. The
+ * order inside a group doesn't matter, so groups are sorted to share more
+ * states. A leftmost DFA drops the groups after the first one that
+ * matches, they started later. Returns -1 if memory runs out. */
+static int dfa_state(DFA *d, int len, bool matched)
+{
+    const NFAState *states = d->nfa->states;
+    int *list = d->list;
+    bool match = false;
+    int out = 0;
+
+    for (int i = 0; i < len;)
+    {
+        if (list[i] == DFA_MARK)
+        {
+            i++;
+            continue;
+        }
+
+        int j = i;
+        bool group_match = false;
+        while (j < len && list[j] != DFA_MARK)
+        {
+            if (states[list[j]].type == NFA_MATCH)
+                group_match = true;
+            j++;
+        }
+
+        qsort(list + i, j - i, sizeof(int), compare_ints);
+        if (out > 0)
+            list[out++] = DFA_MARK;
+        memmove(list + out, list + i, (j - i) * sizeof(int));
+        out += j - i;
+        i = j;
+
+        if (group_match)
+        {
+            match = true;
+            if (d->leftmost)
+            {
+                matched = true;
+                break;
+            }
+        }
+    }
+    len = out;
+
+    unsigned int hash = 2166136261u ^ matched;
+    for (int i = 0; i < len; i++)
+        hash = (hash ^ (unsigned int)list[i]) * 16777619u;
+
+    unsigned int b = hash & (DFA_BUCKETS - 1);
+    for (; d->buckets[b] >= 0; b = (b + 1) & (DFA_BUCKETS - 1))
+    {
+        const DFAState *s = &d->states[d->buckets[b]];
+        if (s->hash == hash && s->len == len && s->matched == matched &&
+            memcmp(s->items, list, len * sizeof(int)) == 0)
+            return d->buckets[b];
+    }
+
+    if (d->num_states == REGEXP_CACHE_STATES)
+    {
+        dfa_flush(d);
+        for (b = hash & (DFA_BUCKETS - 1); d->buckets[b] >= 0; b = (b + 1) & (DFA_BUCKETS - 1))
+            ;
+    }
+
+    DFAState *s = &d->states[d->num_states];
+    s->items = malloc((len ? len : 1) * sizeof(int));
+    if (!s->items)
+    {
+        // TODO: handle memory error
+        return -1;
+    }
+    memcpy(s->items, list, len * sizeof(int));
+    s->len = len;
+    s->hash = hash;
+    s->match = match;
+    s->matched = matched;
+    s->dead = (len == 0 && (!d->unanchored || matched));
+    s->start = false;
+    d->quiet[d->num_states] = !match && !s->dead;
+
+    s->eol_match = match;
+    for (int i = 0; i < len && !s->eol_match; i++)
+    {
+        if (list[i] != DFA_MARK && states[list[i]].type == NFA_EOL)
+            s->eol_match = dfa_matches_at_end(d, list[i], false);
+    }
+
+    int num_classes = d->re->num_classes;
+    for (int c = 0; c < num_classes; c++)
+        d->trans[d->num_states * num_classes + c] = DFA_UNKNOWN;
+
+    d->buckets[b] = d->num_states;
+    return d->num_states++;
+}
+
+static int dfa_start(DFA *d, bool bol)
+{
+    if (d->starts[bol] >= 0)
+        return d->starts[bol];
+
+    int len = 0;
+    d->gen++;
+    dfa_closure(d, d->nfa->start, bol, &len);
+
+    int s = dfa_state(d, len, false);
+    if (s < 0)
+        return -1;
+
+    d->starts[bol] = s;
+    if (!bol && d->re->prefix_len > 0)
+    {
+        d->states[s].start = true;
+        d->quiet[s] = false;
+    }
+
+    return s;
+}
+
+/* Build the transition of state on a byte of the class */
+static int dfa_step(DFA *d, int state, int class)
+{
+    const NFAState *states = d->nfa->states;
+    const DFAState *from = &d->states[state];
+    unsigned char c = d->re->reps[class];
+    bool matched = from->matched;
+    unsigned int flushes = d->flushes;
+    int len = 0;
+
+    d->gen++;
+    for (int i = 0; i < from->len; i++)
+    {
+        int s = from->items[i];
+
+        if (s == DFA_MARK)
+        {
+            if (len > 0 && d->list[len - 1] != DFA_MARK)
+                d->list[len++] = DFA_MARK;
+            continue;
+        }
+
+        if (states[s].type == NFA_SET && set_has(states[s].set, c))
+            dfa_closure(d, states[s].out, false, &len);
+    }
+
+    if (d->unanchored && !matched)
+    {
+        if (d->leftmost && len > 0 && d->list[len - 1] != DFA_MARK)
+            d->list[len++] = DFA_MARK;
+        dfa_closure(d, d->nfa->start, false, &len);
+    }
+
+    int next = dfa_state(d, len, matched);
+
+    /* After a flush the old state is gone, and so is its row */
+    if (next >= 0 && flushes == d->flushes)
+        d->trans[state * d->re->num_classes + class] = next;
+
+    return next;
+}
+
+static int dfa_next(DFA *d, int state, unsigned char c)
+{
+    int class = d->re->classes[c];
+    int next = d->trans[state * d->re->num_classes + class];
+
+    return next != DFA_UNKNOWN ? next : dfa_step(d, state, class);
+}
+
+/* Follow the transitions already built from state through quiet states,
+ * up to n. Returns where the scan stopped. */
+static size_t dfa_run(const DFA *d, int *state, const unsigned char *t, size_t i, size_t n)
+{
+    const uint8_t *classes = d->re->classes;
+    const uint8_t *quiet = d->quiet;
+    const int *trans = d->trans;
+    int num_classes = d->re->num_classes;
+    int s = *state;
+
+    while (i < n)
+    {
+        int next = trans[s * num_classes + classes[t[i]]];
+        if (next == DFA_UNKNOWN || !quiet[next])
+            break;
+        s = next;
+        i++;
+    }
+
+    *state = s;
+    return i;
+}
+
+/* Compilation */
+
+static void build_classes(Regexp *re)
+{
+    const NFA *nfa = &re->forward;
+
+    memset(re->classes, 0, sizeof(re->classes));
+    re->num_classes = 1;
+
+    for (int i = 0; i < nfa->num_states; i++)
+    {
+        if (nfa->states[i].type != NFA_SET)
+            continue;
+
+        /* Split every class in the bytes in the set and the ones out */
+        int split[256][2];
+        int num = 0;
+        memset(split, -1, sizeof(split));
+
+        for (int c = 0; c < 256; c++)
+        {
+            int in = set_has(nfa->states[i].set, c);
+            int *class = &split[re->classes[c]][in];
+            if (*class < 0)
+                *class = num++;
+            re->classes[c] = *class;
+        }
+
+        re->num_classes = num;
+    }
+
+    for (int c = 255; c >= 0; c--)
+        re->reps[re->classes[c]] = c;
+}
+
+static int compile_nfa(const Parser *ps, int root, NFA *nfa, bool reverse, const char **error)
+{
+    int match = nfa_add(nfa, NFA_MATCH, -1, -1, error);
+    nfa->start = compile_node(ps, nfa, root, match, reverse, error);
+
+    return nfa->start < 0 ? -1 : 0;
+}
+
+/**
+ * Compiles the pattern. Returns NULL, with a short description of the
+ * problem in '*error', if the pattern is not valid.
+ */
+Regexp *regexp_compile(const char *pattern, const char **error)
+{
+    Parser ps = {.p = pattern};
+    Regexp *re = calloc(1, sizeof(Regexp));
+    if (!re)
+    {
+        *error = "out of memory";
+        return NULL;
+    }
+
+    int root = parse_alt(&ps);
+    if (root >= 0 && *ps.p == ')')
+    {
+        ps.error = "unmatched )";
+        root = -1;
+    }
+
+    if (root < 0)
+    {
+        *error = ps.error;
+        free(ps.nodes);
+        free(re);
+        return NULL;
+    }
+
+    literal_prefix(&ps, root, re->prefix, &re->prefix_len);
+
+    int res = compile_nfa(&ps, root, &re->forward, false, error);
+    if (res == 0)
+        res = compile_nfa(&ps, root, &re->backward, true, error);
+    free(ps.nodes);
+
+    if (res == 0)
+    {
+        build_classes(re);
+
+        if (dfa_init(&re->search, &re->forward, re, true, true) < 0 ||
+            dfa_init(&re->search_start, &re->backward, re, false, false) < 0 ||
+            dfa_init(&re->last, &re->backward, re, true, false) < 0 ||
+            dfa_init(&re->last_end, &re->forward, re, false, false) < 0)
+        {
+            *error = "out of memory";
+            res = -1;
+        }
+        else
+        {
+            re->empty_match = dfa_matches_at_end(&re->search, re->forward.start, true);
+        }
+    }
+
+    if (res < 0)
+    {
+        regexp_free(re);
+        return NULL;
+    }
+
+    return re;
+}
+
+void regexp_free(Regexp *re)
+{
+    if (re == NULL)
+        return;
+
+    dfa_free(&re->search);
+    dfa_free(&re->search_start);
+    dfa_free(&re->last);
+    dfa_free(&re->last_end);
+    free(re->forward.states);
+    free(re->backward.states);
+    free(re);
+}
+
+/* Searching */
+
+/* The end of the longest match starting at from, run by the anchored
+ * forward DFA */
+static bool longest_from(Regexp *re, const char *s, size_t n, size_t from, size_t *end)
+{
+    DFA *d = &re->last_end;
+    const unsigned char *t = (const unsigned char *)s;
+    size_t last = SIZE_MAX;
+    size_t i = from;
+
+    int state = dfa_start(d, from == 0);
+    if (state < 0)
+        return false;
+    if (d->states[state].match)
+        last = i;
+
+    while (i < n && !d->states[state].dead)
+    {
+        state = dfa_next(d, state, t[i++]);
+        if (state < 0)
+            return false;
+        if (d->states[state].match)
+            last = i;
+    }
+
+    if (i == n && d->states[state].eol_match)
+        last = n;
+
+    *end = last;
+    return last != SIZE_MAX;
+}
+
+/**
+ * Finds the leftmost-longest match that starts at 'from' or after it, in
+ * the first 'n' bytes of 's'. Its bounds go in '*start' and '*end'.
+ */
+bool regexp_search(Regexp *re, const char *s, size_t n, size_t from,
+                   size_t *start, size_t *end)
+{
+    const unsigned char *t = (const unsigned char *)s;
+    DFA *d = &re->search;
+    size_t last = SIZE_MAX;
+    size_t i = from;
+
+    if (from > n)
+        return false;
+
+    if (n == 0)
+    {
+        *start = *end = 0;
+        return re->empty_match;
+    }
+
+    /* Every match starts with the prefix, skip to it */
+    if (re->prefix_len > 0)
+    {
+        const char *p = mem_find(s + i, n - i, re->prefix, re->prefix_len);
+        if (p == NULL)
+            return false;
+        i = p - s;
+    }
+
+    int state = dfa_start(d, i == 0);
+    if (state < 0)
+        return false;
+    if (d->states[state].match)
+        last = i;
+
+    while (i < n && !d->states[state].dead)
+    {
+        if (d->states[state].start)
+        {
+            const char *p = mem_find(s + i, n - i, re->prefix, re->prefix_len);
+            if (p == NULL)
+                break;
+            i = p - s;
+        }
+
+        i = dfa_run(d, &state, t, i, n);
+        if (i == n)
+            break;
+
+        state = dfa_next(d, state, t[i++]);
+        if (state < 0)
+            return false;
+        if (d->states[state].match)
+            last = i;
+    }
+
+    if (i == n && d->states[state].eol_match)
+        last = n;
+    if (last == SIZE_MAX)
+        return false;
+
+    /* The match starts where the longest backward one from its end does */
+    DFA *r = &re->search_start;
+    size_t first = SIZE_MAX;
+    size_t j = last;
+
+    state = dfa_start(r, last == n);
+    if (state < 0)
+        return false;
+    if (r->states[state].match)
+        first = j;
+
+    while (j > from && !r->states[state].dead)
+    {
+        state = dfa_next(r, state, t[--j]);
+        if (state < 0)
+            return false;
+        if (r->states[state].match)
+            first = j;
+    }
+
+    if (j == 0 && r->states[state].eol_match)
+        first = 0;
+    if (first == SIZE_MAX)
+        return false;
+
+    *start = first;
+    *end = last;
+    return true;
+}
+
+/**
+ * Finds the match that starts last before 'limit' (the longest one, if
+ * more start there), in the first 'n' bytes of 's'.
+ */
+bool regexp_search_last(Regexp *re, const char *s, size_t n, size_t limit,
+                        size_t *start, size_t *end)
+{
+    const unsigned char *t = (const unsigned char *)s;
+    DFA *d = &re->last;
+    size_t pos = SIZE_MAX;
+    size_t j = n;
+
+    if (limit > n + 1)
+        limit = n + 1;
+    if (limit == 0)
+        return false;
+
+    if (n == 0)
+    {
+        *start = *end = 0;
+        return re->empty_match;
+    }
+
+    if (re->prefix_len > 0)
+    {
+        size_t hay = limit - 1 + re->prefix_len;
+        if (!mem_rfind(s, hay < n ? hay : n, re->prefix, re->prefix_len))
+            return false;
+    }
+
+    /* Backward, a match ends where a forward one starts */
+    int state = dfa_start(d, true);
+    if (state < 0)
+        return false;
+    if (n < limit && d->states[state].match)
+        pos = n;
+
+    while (pos == SIZE_MAX && j > 0)
+    {
+        state = dfa_next(d, state, t[--j]);
+        if (state < 0)
+            return false;
+        if (j < limit && d->states[state].match)
+            pos = j;
+    }
+
+    if (pos == SIZE_MAX && j == 0 && d->states[state].eol_match)
+        pos = 0;
+    if (pos == SIZE_MAX)
+        return false;
+
+    *start = pos;
+    return longest_from(re, s, n, pos, end);
+}
+
+/* The text every match starts with, which can be searched for first */
+const char *regexp_prefix(const Regexp *re, size_t *len)
+{
+    *len = re->prefix_len;
+    return re->prefix;
+}
@@ -0,0 +1,25 @@
+#ifndef __EDITOR_REGEXP_H
+#define __EDITOR_REGEXP_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Regular expressions matched by automata, in time linear in the text
+ * whatever the pattern. Supported: literals, '.', [classes] with ranges
+ * and negation, \d \w \s (and \D \W \S), escapes of special characters,
+ * ( ) groups, '|', '*', '+', '?', {m}, {m,} and {m,n}, and the '^' and
+ * '$' anchors, which match at the ends of the searched text. Matches are
+ * leftmost-longest. */
+
+typedef struct Regexp Regexp;
+
+Regexp *regexp_compile(const char *pattern, const char **error);
+void regexp_free(Regexp *re);
+
+bool regexp_search(Regexp *re, const char *s, size_t n, size_t from,
+                   size_t *start, size_t *end);
+bool regexp_search_last(Regexp *re, const char *s, size_t n, size_t limit,
+                        size_t *start, size_t *end);
+const char *regexp_prefix(const Regexp *re, size_t *len);
+
+#endif /* __EDITOR_REGEXP_H */
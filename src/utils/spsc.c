@@ -0,0 +1,59 @@
+#include "spsc.h"
+
+#include <stdlib.h>
+
+/* The capacity is rounded up to a power of two */
+int spsc_init(SpscQueue *q, size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    q->slots = malloc(size * sizeof(void *));
+    if (!q->slots)
+        return -1;
+
+    q->mask = size - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+
+    return 0;
+}
+
+void spsc_free(SpscQueue *q)
+{
+    free(q->slots);
+    q->slots = NULL;
+}
+
+/* Return false if the queue is full */
+bool spsc_push(SpscQueue *q, void *item)
+{
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+    if (tail - head > q->mask)
+        return false;
+
+    q->slots[tail & q->mask] = item;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+/* Return false if the queue is empty */
+bool spsc_pop(SpscQueue *q, void **item)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+    if (head == tail)
+        return false;
+
+    *item = q->slots[head & q->mask];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef __EDITOR_SPSC_H
+#define __EDITOR_SPSC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/* Bounded lock-free queue of pointers between exactly one producer thread
+ * and one consumer thread. Each index is written by a single side only and
+ * they are kept on different cache lines. */
+typedef struct SpscQueue
+{
+    void **slots;
+    size_t mask;
+    _Alignas(64) atomic_size_t head; /* Next slot to pop, owned by the consumer */
+    _Alignas(64) atomic_size_t tail; /* Next slot to push, owned by the producer */
+} SpscQueue;
+
+int spsc_init(SpscQueue *q, size_t capacity);
+void spsc_free(SpscQueue *q);
+
+bool spsc_push(SpscQueue *q, void *item);
+bool spsc_pop(SpscQueue *q, void **item);
+
+#endif /* __EDITOR_SPSC_H */
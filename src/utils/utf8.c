@@ -1,6 +1,7 @@
 #include <utf8.h>
 
 #include <stdint.h>
+#include <string.h>
 
 /**
  * Decodes the first UTF-8 character from 's' and stores its codepoint in 'codepoint'.
@@ -82,3 +83,66 @@ int codepoint_to_utf8(uint32_t codepoint, char *out_buffer)
     out_buffer[0] = '?';
     return 1;
 }
+
+/**
+ * Counts the invalid UTF-8 sequences in the first 'len' bytes of 's'.
+ * Runs of ASCII are skipped eight bytes at a time.
+ */
+size_t utf8_count_invalid(const char *s, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    size_t invalid = 0;
+    size_t i = 0;
+
+    while (i < len)
+    {
+        if (len - i >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, p + i, sizeof(word));
+            if ((word & 0x8080808080808080ULL) == 0)
+            {
+                i += 8;
+                continue;
+            }
+        }
+
+        unsigned char c = p[i];
+        size_t n;
+
+        if (c < 0x80)
+            n = 1;
+        else if (c >= 0xC2 && c < 0xE0)
+            n = 2;
+        else if (c >= 0xE0 && c < 0xF0)
+            n = 3;
+        else if (c >= 0xF0 && c < 0xF5)
+            n = 4;
+        else
+            n = 0;
+
+        if (n == 0 || n > len - i)
+        {
+            invalid++;
+            i++;
+            continue;
+        }
+
+        size_t k = 1;
+        while (k < n && (p[i + k] & 0xC0) == 0x80)
+        {
+            k++;
+        }
+
+        if (k < n)
+        {
+            invalid++;
+            i++;
+            continue;
+        }
+
+        i += n;
+    }
+
+    return invalid;
+}
@@ -2,6 +2,7 @@
 #define __EDITOR_UTF8_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define UNICODE_UNKNOWN 0xFFFD
 #define UNICODE_RIGHT_ARROW 0x2192
@@ -24,5 +25,6 @@
 
 int utf8_decode(const char *s, uint32_t *codepoint);
 int codepoint_to_utf8(uint32_t codepoint, char *out_buffer);
+size_t utf8_count_invalid(const char *s, size_t len);
 
 #endif /* __EDITOR_UTF8_H */
@@ -0,0 +1,120 @@
+#include "workpool.h"
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_finished = PTHREAD_COND_INITIALIZER;
+
+static bool initialized = false;
+static size_t num_threads = 0;
+
+/* The current job, protected by lock */
+static unsigned long job_id = 0;
+static work_fn job_fn;
+static void *job_arg;
+static size_t job_tasks, job_next, job_done;
+
+/* Run tasks of the current job until there are none left. Called with
+ * the lock held. */
+static void runTasks(void)
+{
+    while (job_next < job_tasks)
+    {
+        size_t task = job_next++;
+
+        pthread_mutex_unlock(&lock);
+        job_fn(job_arg, task);
+        pthread_mutex_lock(&lock);
+
+        if (++job_done == job_tasks)
+            pthread_cond_broadcast(&job_finished);
+    }
+}
+
+static void *worker(void *unused)
+{
+    (void)unused;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&lock);
+    for (;;)
+    {
+        while (job_id == seen)
+            pthread_cond_wait(&job_ready, &lock);
+
+        seen = job_id;
+        runTasks();
+    }
+
+    return NULL;
+}
+
+/* Start the given number of threads besides the caller. Without a call,
+ * the pool gets one less than the online processors. */
+void work_pool_init(size_t threads)
+{
+    if (initialized)
+        return;
+    initialized = true;
+
+    if (threads > WORK_POOL_MAX_THREADS)
+        threads = WORK_POOL_MAX_THREADS;
+
+    /* Signals are for the main thread, don't let the workers take them */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker, NULL) != 0)
+            break;
+
+        pthread_detach(thread);
+        num_threads++;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+size_t work_pool_threads(void)
+{
+    if (!initialized)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        work_pool_init(cpus > 1 ? (size_t)cpus - 1 : 0);
+    }
+
+    return num_threads;
+}
+
+/* Call fn(arg, task) for every task below tasks, in parallel, and wait
+ * for all of them to return */
+void work_pool_run(work_fn fn, void *arg, size_t tasks)
+{
+    if (tasks == 0)
+        return;
+
+    work_pool_threads();
+
+    pthread_mutex_lock(&lock);
+
+    job_fn = fn;
+    job_arg = arg;
+    job_tasks = tasks;
+    job_next = 0;
+    job_done = 0;
+    job_id++;
+    pthread_cond_broadcast(&job_ready);
+
+    runTasks();
+    while (job_done < job_tasks)
+        pthread_cond_wait(&job_finished, &lock);
+
+    pthread_mutex_unlock(&lock);
+}
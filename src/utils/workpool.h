@@ -0,0 +1,17 @@
+#ifndef __EDITOR_WORKPOOL_H
+#define __EDITOR_WORKPOOL_H
+
+#include <stddef.h>
+
+/* A fixed set of threads, started on first use, that run the tasks of
+ * one job at a time. The calling thread takes part in the job too. */
+
+#define WORK_POOL_MAX_THREADS 15
+
+typedef void (*work_fn)(void *arg, size_t task);
+
+void work_pool_init(size_t threads);
+size_t work_pool_threads(void);
+void work_pool_run(work_fn fn, void *arg, size_t tasks);
+
+#endif /* __EDITOR_WORKPOOL_H */